@@ -0,0 +1,130 @@
+#ifndef ASYNC_HPP_
+#define ASYNC_HPP_
+
+#include <iio.h>
+
+#include <chrono>
+#include <exception>
+#include <fsatutils/iio/channel.hpp>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fsatutils {
+
+namespace iio {
+
+struct AttrRequest {
+  Channel channel;
+  std::string attr;
+};
+
+struct AttrResult {
+  std::optional<std::string> value;
+  std::string error;
+};
+
+/*
+ * Runs channel attribute I/O on one worker thread per IIO context, so requests
+ * to different contexts (e.g. several remote boards) overlap while requests to
+ * the same context stay serialized, as libiio requires. Workers are created on
+ * first use; contexts must outlive the AsyncIO instance.
+ */
+class AsyncIO {
+ public:
+  template <typename AttrType>
+  using Callback =
+      std::function<void(std::optional<AttrType>, std::exception_ptr)>;
+
+  AsyncIO();
+  ~AsyncIO();
+
+  template <typename AttrType>
+  std::future<AttrType> read_attr(Channel ch, std::string attr);
+  template <typename AttrType>
+  void read_attr(Channel ch, std::string attr, Callback<AttrType> done);
+  template <typename AttrType>
+  std::future<void> write_attr(Channel ch, std::string attr, AttrType value);
+
+  /* Reads every request in parallel across contexts and returns once all of
+   * them completed or the timeout expired; unfinished requests are reported
+   * with a "timeout" error and skipped if they have not started yet. */
+  std::vector<AttrResult> gather(std::vector<AttrRequest> requests,
+                                 std::chrono::milliseconds timeout);
+
+  void submit(Channel& ch, std::function<void()> job);
+
+  AsyncIO(const AsyncIO&) = delete;
+  AsyncIO& operator=(const AsyncIO&) = delete;
+  AsyncIO(AsyncIO&&) = delete;
+  AsyncIO& operator=(AsyncIO&&) = delete;
+
+ private:
+  class Worker;
+
+  std::mutex mtx_;
+  std::unordered_map<const struct iio_context*, std::unique_ptr<Worker>>
+      workers_;
+};
+
+template <typename AttrType>
+std::future<AttrType> AsyncIO::read_attr(Channel ch, std::string attr) {
+  auto promise = std::make_shared<std::promise<AttrType>>();
+  auto future = promise->get_future();
+
+  submit(ch, [ch, attr = std::move(attr), promise]() {
+    try {
+      promise->set_value(ch.template read_attr<AttrType>(attr));
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+    }
+  });
+
+  return future;
+}
+
+template <typename AttrType>
+void AsyncIO::read_attr(Channel ch, std::string attr, Callback<AttrType> done) {
+  submit(ch, [ch, attr = std::move(attr), done = std::move(done)]() {
+    std::optional<AttrType> value;
+    std::exception_ptr error;
+
+    try {
+      value = ch.template read_attr<AttrType>(attr);
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    done(std::move(value), error);
+  });
+}
+
+template <typename AttrType>
+std::future<void> AsyncIO::write_attr(Channel ch, std::string attr,
+                                      AttrType value) {
+  auto promise = std::make_shared<std::promise<void>>();
+  auto future = promise->get_future();
+
+  submit(ch, [ch, attr = std::move(attr), value = std::move(value),
+              promise]() mutable {
+    try {
+      ch.template write_attr<AttrType>(attr, value);
+      promise->set_value();
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+    }
+  });
+
+  return future;
+}
+
+}  // namespace iio
+
+}  // namespace fsatutils
+
+#endif
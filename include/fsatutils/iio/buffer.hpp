@@ -0,0 +1,100 @@
+#ifndef BUFFER_HPP_
+#define BUFFER_HPP_
+
+#include <iio.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fsatutils/iio/channel.hpp>
+#include <fsatutils/iio/device.hpp>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace fsatutils {
+
+namespace iio {
+
+class Replay;
+
+struct ChannelLayout {
+  std::string id;
+  std::size_t offset;
+  std::size_t length;
+};
+
+class Buffer {
+ public:
+  Buffer(Device& dev, std::size_t samples, bool cyclic = false);
+  ~Buffer();
+
+  std::size_t refill();
+  void cancel();
+
+  std::span<const std::uint8_t> data() const noexcept { return data_; }
+  std::uint64_t timestamp() const noexcept { return timestamp_; }
+  std::size_t step() const noexcept { return step_; }
+  std::size_t samples() const noexcept {
+    return (step_ != 0U) ? data_.size() / step_ : 0U;
+  }
+
+  std::string const& device_id() const noexcept { return device_id_; }
+  std::vector<ChannelLayout> const& layout() const noexcept { return layout_; }
+
+  const ChannelLayout* find(Channel const& ch) const;
+
+  /* Copies the samples of ch into dst, optionally converting them with the
+   * channel's data format (sign extension, shift and endianness). */
+  template <typename T>
+  std::size_t read(Channel& ch, std::span<T> dst, bool convert = true) const;
+
+  int poll_fd();
+
+  Buffer(const Buffer&) = delete;
+  Buffer& operator=(const Buffer&) = delete;
+  Buffer(Buffer&&) = delete;
+  Buffer& operator=(Buffer&&) = delete;
+
+ private:
+  void compute_layout();
+
+  std::shared_ptr<Context> ctx_;
+  struct iio_device* dev_;
+  struct iio_buffer* raw_ = nullptr;
+  Replay* replay_ = nullptr;
+  std::size_t stream_ = 0;
+  std::size_t cursor_ = 0;
+  std::string device_id_;
+  std::span<const std::uint8_t> data_;
+  std::uint64_t timestamp_ = 0;
+  std::size_t step_ = 0;
+  std::vector<ChannelLayout> layout_;
+};
+
+template <typename T>
+std::size_t Buffer::read(Channel& ch, std::span<T> dst, bool convert) const {
+  const ChannelLayout* l = find(ch);
+
+  if (l == nullptr || l->length != sizeof(T)) return 0;
+
+  std::size_t count = std::min(dst.size(), samples());
+  const std::uint8_t* src = data_.data() + l->offset;
+
+  for (std::size_t i = 0; i < count; i++, src += step_) {
+    if (convert) {
+      iio_channel_convert(ch, &dst[i], src);
+    } else {
+      std::memcpy(&dst[i], src, sizeof(T));
+    }
+  }
+
+  return count;
+}
+
+}  // namespace iio
+
+}  // namespace fsatutils
+
+#endif
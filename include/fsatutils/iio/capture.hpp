@@ -0,0 +1,137 @@
+#ifndef CAPTURE_HPP_
+#define CAPTURE_HPP_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fsatutils/iio/buffer.hpp>
+#include <fsatutils/iio/device.hpp>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fsatutils {
+
+namespace iio {
+
+/*
+ * Captures several devices at once and merges their samples into frames on a
+ * common time grid. Each device is refilled by its own thread and hands its
+ * blocks to the merge thread through a single-producer/single-consumer ring,
+ * so the data path takes no locks. Channel values are linearly interpolated at
+ * the frame timestamps using each device's timestamp channel.
+ */
+class CaptureGroup {
+ public:
+  struct Frame {
+    std::uint64_t timestamp_ns;
+    std::span<const double> values;
+    std::uint64_t gap_mask;
+  };
+
+  /* drift_ns is the smoothed offset between the newest timestamp of a device
+   * and the one of the first device added to the group. */
+  struct SourceStats {
+    std::string device;
+    std::uint64_t blocks;
+    std::uint64_t samples;
+    std::uint64_t overruns;
+    std::uint64_t gaps;
+    std::uint64_t gap_ns;
+    double period_ns;
+    double drift_ns;
+  };
+
+  struct Stats {
+    std::uint64_t frames;
+    std::uint64_t gap_frames;
+    std::vector<SourceStats> sources;
+  };
+
+  using FrameCallback = std::function<void(Frame const&)>;
+
+  CaptureGroup(std::chrono::nanoseconds frame_period,
+               std::chrono::nanoseconds max_latency,
+               std::size_t buffer_samples = 1024U);
+  ~CaptureGroup();
+
+  void add(Device dev, std::vector<std::string> channels,
+           std::string timestamp_channel = "timestamp");
+
+  void start(FrameCallback cb);
+  void stop();
+
+  Stats stats() const;
+
+  CaptureGroup(const CaptureGroup&) = delete;
+  CaptureGroup& operator=(const CaptureGroup&) = delete;
+  CaptureGroup(CaptureGroup&&) = delete;
+  CaptureGroup& operator=(CaptureGroup&&) = delete;
+
+ private:
+  static constexpr std::size_t RING_SIZE = 8U;
+
+  struct Chunk {
+    std::vector<std::int64_t> ts;
+    std::vector<double> values;
+    std::size_t count;
+  };
+
+  struct Source {
+    explicit Source(Device dev) : device{std::move(dev)} {}
+
+    Device device;
+    std::vector<Channel> channels;
+    std::optional<Channel> ts_channel;
+    std::unique_ptr<Buffer> buffer;
+    std::array<Chunk, RING_SIZE> ring;
+    std::atomic<std::size_t> head = 0;
+    std::atomic<std::size_t> tail = 0;
+    std::atomic<bool> finished = false;
+    std::atomic<std::int64_t> newest_ts = 0;
+
+    /* Producer state, only touched by the refill thread */
+    std::int64_t fill_last_ts = 0;
+
+    /* Merge state, only touched by the merge thread */
+    std::size_t pos = 0;
+    bool has_prev = false;
+    std::int64_t prev_ts = 0;
+    std::vector<double> prev;
+
+    std::atomic<std::uint64_t> blocks = 0;
+    std::atomic<std::uint64_t> samples = 0;
+    std::atomic<std::uint64_t> overruns = 0;
+    std::atomic<std::uint64_t> gaps = 0;
+    std::atomic<std::uint64_t> gap_ns = 0;
+    std::atomic<double> period_ns = 0.0;
+    std::atomic<double> drift_ns = 0.0;
+  };
+
+  void refillTask(std::stop_token stoken, Source& src);
+  void mergeTask(std::stop_token stoken);
+  bool sample(Source& src, std::int64_t t, double* out);
+
+  std::int64_t frame_period_ns_;
+  std::int64_t max_latency_ns_;
+  std::size_t buffer_samples_;
+  std::vector<std::unique_ptr<Source>> sources_;
+  std::vector<double> frame_values_;
+  FrameCallback cb_;
+  std::atomic<std::uint64_t> published_ = 0;
+  std::atomic<std::uint64_t> frames_ = 0;
+  std::atomic<std::uint64_t> gap_frames_ = 0;
+  std::vector<std::jthread> refill_threads_;
+  std::jthread merge_thread_;
+};
+
+}  // namespace iio
+
+}  // namespace fsatutils
+
+#endif
@@ -3,30 +3,44 @@
 
 #include <iio.h>
 
+#include <optional>
 #include <string>
 
 namespace fsatutils {
 
 namespace iio {
 
+class Replay;
+
 class Channel {
  public:
-  Channel(std::string name, struct iio_device* device, bool output_channel);
+  Channel(std::string name, struct iio_device* device, bool output_channel,
+          Replay* replay = nullptr);
 
   template <typename AttrType>
   void write_attr(std::string const& attr, AttrType const& value);
   template <typename AttrType>
   AttrType read_attr(std::string const& attr) const;
 
+  void enable() { iio_channel_enable(raw_); }
+  void disable() { iio_channel_disable(raw_); }
+  bool enabled() const { return iio_channel_is_enabled(raw_); }
+
   std::string name() const noexcept { return name_; }
+  std::string id() const { return iio_channel_get_id(raw_); }
+  bool output() const noexcept { return output_; }
 
   operator struct iio_channel*() { return raw_; };
 
  private:
+  std::optional<std::string> replayed_attr(std::string const& attr) const;
+  bool replay_write(std::string const& attr, std::string const& value);
+
   struct iio_channel* raw_;
   struct iio_device* dev_;
   std::string name_;
   bool output_;
+  Replay* replay_;
 };
 
 }  // namespace iio
@@ -3,7 +3,9 @@
 
 #include <iio.h>
 
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace fsatutils {
 
@@ -15,17 +17,44 @@ enum class ContextType {
   USB,
   XML,
   DEFAULT,
+  REPLAY,
 };
 
+class Replay;
+
 class Context {
  public:
   Context(ContextType type);
   Context(ContextType type, std::string&);
+
+  /*
+   * Creates a context whose description is cached in cache_path. If the cache
+   * exists, devices are enumerated from it and the connection to the live
+   * context is deferred until it is first needed, at which point the cache is
+   * revalidated (and rewritten if the remote description changed).
+   */
+  Context(ContextType type, std::string const& uri, std::string cache_path);
   ~Context();
 
   ContextType type() const { return type_; };
 
-  operator struct iio_context*() { return raw_; };
+  std::vector<std::string> device_names();
+
+  bool save_description(std::string const& path);
+
+  bool revalidate();
+
+  bool is_live() const noexcept { return raw_ != nullptr; }
+
+  /* The live context if connected, the cached description otherwise; only
+   * valid until the context goes live */
+  struct iio_context* description() const noexcept {
+    return (raw_ != nullptr) ? raw_ : cached_;
+  }
+
+  Replay* replay() const noexcept { return replay_.get(); }
+
+  operator struct iio_context*() { return live(); };
 
   Context(const Context&) = delete;
   Context& operator=(const Context&) = delete;
@@ -33,8 +62,16 @@ class Context {
   Context& operator=(Context&&) = delete;
 
  private:
-  struct iio_context* raw_;
+  struct iio_context* create(ContextType type, std::string const& uri);
+
+  struct iio_context* live();
+
+  struct iio_context* raw_ = nullptr;
+  struct iio_context* cached_ = nullptr;
   ContextType type_;
+  std::string uri_;
+  std::string cache_path_;
+  std::shared_ptr<Replay> replay_;
 };
 
 }  // namespace iio
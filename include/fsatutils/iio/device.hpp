@@ -12,19 +12,28 @@ namespace fsatutils {
 
 namespace iio {
 
+class EventStream;
+
 class Device {
 public:
   Device(std::shared_ptr<Context> ctx, std::string name);
 
   Channel find_device_channel(std::string const &channel_name, bool output);
 
+  EventStream open_events();
+
   std::string name() const noexcept { return name_; }
 
-  operator struct iio_device *() { return raw_; };
+  std::shared_ptr<Context> context() const noexcept { return ctx_; }
+
+  operator struct iio_device *() { return resolve(); };
 
 private:
+  /* Looked up in the live context on first use, connecting it if needed */
+  struct iio_device *resolve();
+
   std::shared_ptr<Context> ctx_;
-  struct iio_device *raw_;
+  struct iio_device *raw_ = nullptr;
   std::string name_;
 };
 
@@ -0,0 +1,149 @@
+#ifndef DISK_HPP_
+#define DISK_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fsatutils/iio/buffer.hpp>
+#include <fsatutils/iio/context.hpp>
+#include <fsatutils/iio/recording.hpp>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fsatutils {
+
+namespace iio {
+
+/*
+ * Recorder for sustained high-rate captures. record() only copies the block
+ * into one of a fixed pool of page-aligned buffers; full buffers are written
+ * by a background thread with O_DIRECT (io_uring when built with liburing),
+ * so disk stalls never block the capture thread. When every buffer is in
+ * flight the block is dropped and counted instead. The file uses the same
+ * format as Recorder and can be opened with Replay.
+ */
+class DiskRecorder {
+ public:
+  struct Options {
+    std::size_t buffer_size;
+    std::size_t buffers;
+    std::size_t preallocate;
+    bool direct;
+  };
+
+  struct Stats {
+    std::uint64_t records;
+    std::uint64_t bytes_written;
+    std::uint64_t dropped;
+    std::uint64_t write_errors;
+    std::size_t peak_queue;
+    double throughput_bps;
+  };
+
+  static constexpr Options DEFAULT_OPTIONS = {
+      .buffer_size = 4U << 20U,
+      .buffers = 8U,
+      .preallocate = 256U << 20U,
+      .direct = true,
+  };
+
+  DiskRecorder(std::shared_ptr<Context> ctx, std::string path,
+               Options opts = DEFAULT_OPTIONS);
+  ~DiskRecorder();
+
+  /* Returns false when the block had to be dropped */
+  bool record(Buffer const& buf);
+  void close();
+
+  Stats stats() const;
+
+  DiskRecorder(const DiskRecorder&) = delete;
+  DiskRecorder& operator=(const DiskRecorder&) = delete;
+  DiskRecorder(DiskRecorder&&) = delete;
+  DiskRecorder& operator=(DiskRecorder&&) = delete;
+
+ private:
+  struct Job {
+    std::uint8_t* data;
+    std::size_t size;
+    std::uint64_t offset;
+    std::size_t slot;  // NO_SLOT for one-off oversized buffers
+  };
+
+  struct Uring;
+
+  static constexpr std::size_t NO_SLOT = ~std::size_t{0};
+
+  bool append(recording::RecordType type, std::uint16_t stream,
+              std::uint64_t ts,
+              std::initializer_list<std::span<const std::uint8_t>> parts);
+  bool append_oversized(
+      recording::RecordType type, std::uint16_t stream, std::uint64_t ts,
+      std::initializer_list<std::span<const std::uint8_t>> parts);
+  std::optional<std::uint16_t> stream_for(Buffer const& buf);
+  bool acquire();
+  void submit_current(bool shrink);
+  void push(Job job);
+  void release(Job const& job);
+  bool write_sync(Job const& job);
+  void grow(std::uint64_t end);
+  void workTask(std::stop_token stoken);
+
+  std::shared_ptr<Context> ctx_;
+  std::string path_;
+  Options opts_;
+  int fd_ = -1;
+  bool closed_ = false;
+  std::uint8_t* header_ = nullptr;
+  std::size_t header_size_ = 0;
+  std::uint64_t start_ns_;
+
+  /* Producer side, guarded by mtx_ */
+  std::mutex mtx_;
+  std::size_t current_ = NO_SLOT;
+  std::size_t fill_ = 0;
+  std::uint64_t current_offset_ = 0;
+  std::uint64_t next_offset_ = 0;
+  std::uint64_t data_end_ = 0;
+  std::vector<recording::IndexEntry> index_;
+  std::vector<std::vector<std::uint8_t>> streams_;
+  const Buffer* last_buf_ = nullptr;
+  std::string last_device_;
+  std::size_t last_step_ = 0;
+  std::uint16_t last_stream_ = 0;
+
+  /* Buffer pool and write queue, guarded by queue_mtx_ */
+  std::mutex queue_mtx_;
+  std::condition_variable_any cv_;
+  std::vector<std::uint8_t*> slots_;
+  std::vector<std::size_t> free_;
+  std::deque<Job> queue_;
+  std::size_t inflight_ = 0;
+
+  /* Only touched by the writer thread */
+  std::uint64_t allocated_ = 0;
+
+  std::atomic<std::uint64_t> records_ = 0;
+  std::atomic<std::uint64_t> bytes_written_ = 0;
+  std::atomic<std::uint64_t> dropped_ = 0;
+  std::atomic<std::uint64_t> write_errors_ = 0;
+  std::atomic<std::size_t> peak_queue_ = 0;
+  std::chrono::steady_clock::time_point started_;
+
+  std::unique_ptr<Uring> uring_;
+  std::jthread thread_;
+};
+
+}  // namespace iio
+
+}  // namespace fsatutils
+
+#endif
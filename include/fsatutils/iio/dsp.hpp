@@ -0,0 +1,152 @@
+#ifndef DSP_HPP_
+#define DSP_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace fsatutils {
+
+namespace iio {
+
+/*
+ * Block processing stage for per-channel sample spans (e.g. filled with
+ * Buffer::read). process() returns a view into the stage's own output
+ * storage, valid until the next call, so stages chain without copies. State
+ * is carried across blocks, so a stream can be fed in blocks of any size.
+ */
+class Stage {
+ public:
+  virtual ~Stage() = default;
+
+  virtual std::span<const float> process(std::span<const float> in) = 0;
+  virtual void reset() = 0;
+
+  /* Upper bound of output samples for an input block, used to size buffers */
+  virtual std::size_t max_output(std::size_t input) const = 0;
+
+  virtual void reserve(std::size_t max_block) {
+    out_.reserve(max_output(max_block));
+  }
+
+ protected:
+  std::span<float> output(std::size_t input) {
+    out_.resize(std::max(out_.size(), max_output(input)));
+    return out_;
+  }
+
+  std::vector<float> out_;
+};
+
+enum class Reduce : std::uint8_t {
+  MIN,
+  MAX,
+  MEAN,
+};
+
+class Decimator : public Stage {
+ public:
+  Decimator(std::size_t factor, Reduce mode);
+
+  std::span<const float> process(std::span<const float> in) override;
+  void reset() override;
+  std::size_t max_output(std::size_t input) const override;
+
+ private:
+  std::size_t factor_;
+  Reduce mode_;
+  std::size_t count_ = 0;
+  float min_;
+  float max_;
+  double sum_;
+};
+
+enum class Statistic : std::uint8_t {
+  MEAN,
+  VARIANCE,
+  RMS,
+};
+
+class MovingStats : public Stage {
+ public:
+  MovingStats(std::size_t window, Statistic stat);
+
+  std::span<const float> process(std::span<const float> in) override;
+  void reset() override;
+  std::size_t max_output(std::size_t input) const override { return input; }
+
+ private:
+  Statistic stat_;
+  std::vector<float> window_;
+  std::size_t pos_ = 0;
+  std::size_t filled_ = 0;
+  double sum_ = 0.0;
+  double sum_sq_ = 0.0;
+};
+
+class Fir : public Stage {
+ public:
+  explicit Fir(std::vector<float> taps, std::size_t decimation = 1);
+
+  std::span<const float> process(std::span<const float> in) override;
+  void reset() override;
+  std::size_t max_output(std::size_t input) const override;
+  void reserve(std::size_t max_block) override;
+
+ private:
+  std::vector<float> taps_;  // reversed, so outputs are plain dot products
+  std::size_t decimation_;
+  std::size_t phase_ = 0;
+  std::vector<float> work_;  // taps - 1 samples of history, then the block
+};
+
+/*
+ * Cascaded integrator-comb decimator. Inputs are rounded to integers (feed
+ * raw codes, Buffer::read with convert = false) so the integrators wrap
+ * exactly; outputs are normalized by the filter gain (R * M)^N.
+ */
+class Cic : public Stage {
+ public:
+  Cic(std::size_t order, std::size_t decimation, std::size_t delay = 1);
+
+  std::span<const float> process(std::span<const float> in) override;
+  void reset() override;
+  std::size_t max_output(std::size_t input) const override;
+
+ private:
+  std::size_t decimation_;
+  std::size_t delay_;
+  std::size_t phase_ = 0;
+  double gain_;
+  std::vector<std::int64_t> integrators_;
+  std::vector<std::int64_t> combs_;  // order * delay previous comb inputs
+};
+
+class Pipeline {
+ public:
+  Pipeline& add(std::unique_ptr<Stage> stage);
+
+  template <typename S, typename... Args>
+  Pipeline& emplace(Args&&... args) {
+    return add(std::make_unique<S>(std::forward<Args>(args)...));
+  }
+
+  /* Preallocates every stage output for blocks of up to max_block samples */
+  void reserve(std::size_t max_block);
+
+  std::span<const float> process(std::span<const float> in);
+  void reset();
+
+ private:
+  std::vector<std::unique_ptr<Stage>> stages_;
+};
+
+}  // namespace iio
+
+}  // namespace fsatutils
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef EVENT_HPP_
+#define EVENT_HPP_
+
+#include <iio.h>
+
+#include <chrono>
+#include <cstdint>
+#include <fsatutils/iio/device.hpp>
+#include <functional>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fsatutils {
+
+namespace iio {
+
+enum class EventType : std::uint8_t {
+  THRESH,
+  MAG,
+  ROC,
+  THRESH_ADAPTIVE,
+  MAG_ADAPTIVE,
+  CHANGE,
+  MAG_REFERENCED,
+  GESTURE,
+};
+
+enum class EventDirection : std::uint8_t {
+  EITHER,
+  RISING,
+  FALLING,
+  NONE,
+  SINGLETAP,
+  DOUBLETAP,
+};
+
+struct Event {
+  std::uint64_t id;
+  std::int64_t timestamp_ns;
+  enum iio_chan_type chan_type;
+  int channel;
+  int channel2;
+  std::uint8_t modifier;
+  bool differential;
+  EventType type;
+  EventDirection direction;
+};
+
+/*
+ * Event stream of a local IIO device, read from the anonymous event fd the
+ * kernel hands out for /dev/iio:deviceX. The fd is non-blocking and can be
+ * registered in any epoll/poll loop; EventReactor does that for a set of
+ * streams. libiio does not expose events, so network contexts are not
+ * supported.
+ */
+class EventStream {
+ public:
+  explicit EventStream(Device& dev);
+  ~EventStream();
+
+  EventStream(EventStream&& other) noexcept;
+  EventStream& operator=(EventStream&& other) noexcept;
+  EventStream(const EventStream&) = delete;
+  EventStream& operator=(const EventStream&) = delete;
+
+  int fd() const noexcept { return fd_; }
+  std::string const& device_id() const noexcept { return device_id_; }
+
+  std::size_t read(std::span<Event> events);
+  std::optional<Event> next(std::chrono::milliseconds timeout);
+
+  /* Writes a sysfs event attribute, e.g. in_voltage0_thresh_rising_en */
+  void enable(std::string const& attr, bool enabled = true);
+  void set(std::string const& attr, std::string const& value);
+
+  static Event decode(std::uint64_t id, std::int64_t timestamp);
+
+ private:
+  std::string device_id_;
+  int fd_ = -1;
+};
+
+class EventReactor {
+ public:
+  using Handler = std::function<void(EventStream&, Event const&)>;
+
+  EventReactor();
+  ~EventReactor();
+
+  /* Safe to call from handlers; changes made while dispatching take effect
+   * once the current pass is over */
+  void add(EventStream& stream, Handler handler);
+  void remove(EventStream& stream);
+
+  std::size_t run_once(std::chrono::milliseconds timeout);
+  void run(std::stop_token stoken,
+           std::chrono::milliseconds tick = std::chrono::milliseconds{100});
+
+  EventReactor(const EventReactor&) = delete;
+  EventReactor& operator=(const EventReactor&) = delete;
+  EventReactor(EventReactor&&) = delete;
+  EventReactor& operator=(EventReactor&&) = delete;
+
+ private:
+  struct Watch {
+    EventStream* stream;
+    Handler handler;
+    bool removed;
+  };
+
+  /* Applies the changes handlers made during a dispatch pass */
+  void settle();
+
+  int epfd_;
+  std::unordered_map<int, Watch> handlers_;
+  std::vector<std::pair<int, Watch>> added_;
+  bool dispatching_ = false;
+};
+
+}  // namespace iio
+
+}  // namespace fsatutils
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef PROFILE_HPP_
+#define PROFILE_HPP_
+
+#include <cstddef>
+#include <fsatutils/iio/context.hpp>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fsatutils {
+
+namespace iio {
+
+struct AttrSetting {
+  std::string channel;
+  bool output;
+  std::string attr;
+  std::string value;
+};
+
+struct DeviceProfile {
+  std::string device;
+  std::vector<AttrSetting> settings;
+};
+
+/*
+ * Declarative set of channel attribute values. Loaded from JSON shaped as
+ *
+ *   {"devices": [{"name": "ad9361-phy", "channels": [
+ *       {"name": "voltage0", "output": false,
+ *        "attrs": {"hardwaregain": 10, "rf_port_select": "A_BALANCED"}}]}]}
+ *
+ * apply() only writes the attributes whose current value differs, reading
+ * the current state with one bulk request per channel (or from the cache left
+ * by a previous apply) and batching the writes per channel.
+ */
+class Profile {
+ public:
+  using StateCache = std::map<std::string, std::string, std::less<>>;
+
+  struct ApplyStats {
+    std::size_t checked;
+    std::size_t written;
+    std::size_t unchanged;
+    std::size_t failed;
+    std::size_t round_trips;
+  };
+
+  static Profile from_json(std::string_view json);
+  static Profile from_file(std::string const& path);
+
+  void set(std::string const& device, std::string const& channel, bool output,
+           std::string const& attr, std::string value);
+
+  ApplyStats apply(std::shared_ptr<Context> ctx, StateCache* cache = nullptr);
+
+  std::vector<DeviceProfile> const& devices() const noexcept {
+    return devices_;
+  }
+
+ private:
+  std::vector<DeviceProfile> devices_;
+};
+
+}  // namespace iio
+
+}  // namespace fsatutils
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef RECORDING_HPP_
+#define RECORDING_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fsatutils/iio/buffer.hpp>
+#include <fsatutils/iio/context.hpp>
+#include <fsatutils/iio/device.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fsatutils {
+
+namespace iio {
+
+/*
+ * On-disk layout of a recording:
+ *
+ *   FileHeader | context XML | records... | IndexEntry[index_count]
+ *
+ * Every record starts with a RecordHeader and is padded to 8 bytes so block
+ * payloads can be accessed in place once the file is memory-mapped. PAD
+ * records fill the unused tail of fixed-size write buffers and carry no
+ * data. The index is only written when the recording is closed; readers
+ * rebuild it by walking the records when index_offset is zero.
+ */
+namespace recording {
+
+inline constexpr char MAGIC[8] = {'F', 'S', 'A', 'T', 'R', 'E', 'C', '\0'};
+inline constexpr std::uint16_t VERSION = 1;
+inline constexpr std::size_t ALIGNMENT = 8U;
+
+enum class RecordType : std::uint8_t {
+  NONE = 0,
+  LAYOUT = 1,
+  BLOCK = 2,
+  ATTR = 3,
+  PAD = 4,
+};
+
+struct FileHeader {
+  char magic[8];
+  std::uint16_t version;
+  std::uint16_t reserved;
+  std::uint32_t stream_count;
+  std::uint64_t description_offset;
+  std::uint64_t description_size;
+  std::uint64_t data_offset;
+  std::uint64_t index_offset;
+  std::uint64_t index_count;
+  std::uint64_t start_ns;
+};
+
+struct RecordHeader {
+  RecordType type;
+  std::uint8_t reserved;
+  std::uint16_t stream;
+  std::uint32_t size;
+  std::uint64_t timestamp_ns;
+};
+
+struct IndexEntry {
+  std::uint64_t offset;
+  std::uint64_t timestamp_ns;
+  RecordType type;
+  std::uint8_t reserved;
+  std::uint16_t stream;
+  std::uint32_t size;
+};
+
+constexpr std::size_t align(std::size_t n) {
+  return (n + ALIGNMENT - 1U) & ~(ALIGNMENT - 1U);
+}
+
+std::vector<std::uint8_t> encode_layout(std::string_view device,
+                                        std::size_t step,
+                                        std::vector<ChannelLayout> const& l);
+
+std::string attr_key(std::string_view device, std::string_view channel,
+                     bool output, std::string_view attr);
+
+std::uint64_t now_ns();
+
+}  // namespace recording
+
+class Recorder {
+ public:
+  Recorder(std::shared_ptr<Context> ctx, std::string path,
+           std::size_t chunk_size = 64U << 20U);
+  ~Recorder();
+
+  void record(Buffer const& buf);
+  void snapshot_attrs(Device& dev);
+  void close();
+
+  std::size_t size() const noexcept { return used_; }
+
+  Recorder(const Recorder&) = delete;
+  Recorder& operator=(const Recorder&) = delete;
+  Recorder(Recorder&&) = delete;
+  Recorder& operator=(Recorder&&) = delete;
+
+ private:
+  std::uint8_t* reserve(std::size_t bytes);
+  void append(recording::RecordType type, std::uint16_t stream,
+              std::uint64_t ts,
+              std::initializer_list<std::span<const std::uint8_t>> parts);
+  std::uint16_t stream_for(Buffer const& buf);
+
+  std::shared_ptr<Context> ctx_;
+  std::string path_;
+  int fd_ = -1;
+  std::uint8_t* map_ = nullptr;
+  std::size_t mapped_ = 0;
+  std::size_t used_ = 0;
+  std::size_t chunk_;
+  std::vector<recording::IndexEntry> index_;
+  std::vector<std::vector<std::uint8_t>> streams_;
+  std::mutex mtx_;
+};
+
+class Replay {
+ public:
+  enum class Speed {
+    REALTIME,
+    SCALED,
+    MAX,
+  };
+
+  struct Stream {
+    std::string device;
+    std::size_t step;
+    std::vector<ChannelLayout> layout;
+    std::vector<recording::IndexEntry> blocks;
+  };
+
+  struct Block {
+    std::span<const std::uint8_t> data;
+    std::uint64_t timestamp_ns;
+  };
+
+  explicit Replay(std::string const& path);
+  ~Replay();
+
+  std::string_view description() const noexcept { return description_; }
+
+  void set_speed(Speed speed, double scale = 1.0);
+  void set_loop(bool loop) noexcept { loop_ = loop; }
+
+  std::optional<std::size_t> find_stream(std::string_view device) const;
+  Stream const& stream(std::size_t idx) const { return streams_.at(idx); }
+
+  /* Returns the n-th block of a stream, sleeping until it is due according to
+   * the configured speed. */
+  std::optional<Block> block(std::size_t stream, std::size_t n);
+
+  std::optional<std::string> attr(std::string_view device,
+                                  std::string_view channel, bool output,
+                                  std::string_view attr) const;
+  void write_attr(std::string_view device, std::string_view channel,
+                  bool output, std::string_view attr, std::string value);
+
+  Replay(const Replay&) = delete;
+  Replay& operator=(const Replay&) = delete;
+  Replay(Replay&&) = delete;
+  Replay& operator=(Replay&&) = delete;
+
+ private:
+  void load_index(recording::FileHeader const& hdr);
+  void add_record(recording::IndexEntry const& entry);
+
+  const std::uint8_t* map_ = nullptr;
+  std::size_t size_ = 0;
+  std::string_view description_;
+  std::uint64_t start_ns_ = 0;
+  std::uint64_t end_ns_ = 0;
+  /* Snapshots taken up to the first block are the state replay starts in */
+  std::uint64_t first_block_ns_ = 0;
+  std::vector<Stream> streams_;
+  std::map<std::string, std::vector<std::pair<std::uint64_t, std::string_view>>,
+           std::less<>>
+      attrs_;
+
+  Speed speed_ = Speed::REALTIME;
+  double scale_ = 1.0;
+  bool loop_ = false;
+  std::once_flag started_;
+  std::chrono::steady_clock::time_point wall_start_;
+  /* Latest block timestamp handed out, laps included */
+  std::atomic<std::uint64_t> position_ns_ = 0;
+
+  mutable std::mutex overrides_mtx_;
+  std::map<std::string, std::string, std::less<>> overrides_;
+};
+
+}  // namespace iio
+
+}  // namespace fsatutils
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef SAMPLER_HPP_
+#define SAMPLER_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <fsatutils/iio/channel.hpp>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fsatutils {
+
+namespace iio {
+
+struct Sample {
+  std::string device;
+  std::string channel;
+  std::string attr;
+  std::string value;
+  std::uint64_t scheduled_ns;
+  std::uint64_t timestamp_ns;
+  /* Wall-clock time of the read, for anything kept across reboots */
+  std::uint64_t wall_ns;
+};
+
+/*
+ * Periodic channel attribute sampler. Registered reads are kept in a hashed
+ * timer wheel; every tick the due reads are grouped per device and channel so
+ * a channel with several due attributes is read with a single bulk request.
+ * Channels are stored by value, so their devices must outlive the sampler.
+ * Callbacks and the publisher run on the sampler thread without its lock
+ * held, so they may add or remove reads; a read removed while its sample is
+ * being delivered may still see that last sample.
+ */
+class Sampler {
+ public:
+  using Callback = std::function<void(Sample const&)>;
+  using Publisher =
+      std::function<bool(std::string_view topic, std::span<std::uint8_t> data)>;
+
+  struct Stats {
+    std::uint64_t reads;
+    std::uint64_t batches;
+    std::uint64_t failures;
+    std::uint64_t missed_deadlines;
+    std::uint64_t max_jitter_ns;
+    double mean_jitter_ns;
+  };
+
+  Sampler(std::chrono::milliseconds tick = std::chrono::milliseconds{1},
+          std::size_t slots = 1024U);
+  ~Sampler();
+
+  std::size_t add(Channel ch, std::string attr,
+                  std::chrono::milliseconds period, Callback cb);
+  std::size_t add(Channel ch, std::string attr,
+                  std::chrono::milliseconds period, std::string topic);
+  bool remove(std::size_t id);
+
+  void set_publisher(Publisher pub);
+
+  void start();
+  void stop();
+
+  Stats stats() const;
+
+  Sampler(const Sampler&) = delete;
+  Sampler& operator=(const Sampler&) = delete;
+  Sampler(Sampler&&) = delete;
+  Sampler& operator=(Sampler&&) = delete;
+
+ private:
+  struct Entry {
+    Channel channel;
+    std::string attr;
+    std::uint64_t period_ns;
+    std::uint64_t due_ns;
+    Callback cb;
+    std::string topic;
+  };
+
+  /* A sample taken under the lock, handed out once it is released */
+  struct Delivery {
+    Sample sample;
+    Callback cb;
+    std::string topic;
+  };
+
+  std::size_t insert(Entry entry);
+  void schedule(std::size_t id);
+  void workTask(std::stop_token stoken);
+  void runTick(std::uint64_t tick);
+  void readBatch(std::vector<std::size_t> const& ids);
+  void collect(Entry& e, std::string value, std::uint64_t ts,
+               std::uint64_t wall);
+  void deliver(Delivery& d, Publisher const& publisher);
+
+  std::uint64_t tick_ns_;
+  std::uint64_t epoch_ns_ = 0;
+  std::vector<std::vector<std::size_t>> wheel_;
+  std::unordered_map<std::size_t, Entry> entries_;
+  std::size_t next_id_ = 0;
+  std::vector<Delivery> pending_;
+  Publisher publisher_;
+  Stats stats_{};
+  std::uint64_t jitter_sum_ns_ = 0;
+  mutable std::mutex mtx_;
+  std::jthread work_thread_;
+};
+
+}  // namespace iio
+
+}  // namespace fsatutils
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef BINLOG_HPP_
+#define BINLOG_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fsatutils/log/log.hpp>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Deferred-format logging for hot paths. The call site only stores the ID of
+ * its static format descriptor, a timestamp and the raw arguments in a
+ * per-thread ring; a background thread formats them through logs::log, or
+ * writes them to a binary file that fsat-logdecode turns back into text.
+ * Arguments must be integers, floating point values, pointers or strings
+ * (strings are copied, up to MAX_STRING bytes).
+ *
+ *   FSAT_BINLOG(DEBUG, "adc %s raw=%d scale=%f", name, raw, scale);
+ */
+#define FSAT_BINLOG(level, fmt, ...)                                       \
+  do {                                                                     \
+    if constexpr ((level) >= (FSATUTILS_LOG_FLOOR)) {                      \
+      if ((level) >= logs::global_log_level) {                             \
+        static logs::binlog::Site fsat_binlog_site_{(level), (fmt),        \
+                                                    __FILE__, __LINE__};   \
+        logs::binlog::emit(fsat_binlog_site_ __VA_OPT__(, ) __VA_ARGS__);  \
+      }                                                                    \
+    }                                                                      \
+  } while (0)
+
+namespace logs {
+
+namespace binlog {
+
+inline constexpr char MAGIC[8] = {'F', 'S', 'A', 'T', 'B', 'L', 'G', '\0'};
+inline constexpr std::uint16_t VERSION = 1;
+inline constexpr std::uint32_t UNREGISTERED = ~std::uint32_t{0};
+inline constexpr std::size_t MAX_STRING = 255U;
+
+enum class RecordType : std::uint8_t {
+  SITE = 1,
+  ENTRY = 2,
+  DROPPED = 3,
+};
+
+struct FileHeader {
+  char magic[8];
+  std::uint16_t version;
+  std::uint16_t reserved;
+  std::uint32_t reserved2;
+  std::uint64_t steady_start_ns;
+  std::uint64_t realtime_start_ns;
+};
+
+struct RecordHeader {
+  RecordType type;
+  std::uint8_t reserved;
+  std::uint16_t reserved2;
+  std::uint32_t size;
+};
+
+struct Site {
+  constexpr Site(LogLevel lvl, const char* f, const char* src, int ln)
+      : level{lvl}, fmt{f}, file{src}, line{ln} {}
+
+  LogLevel level;
+  const char* fmt;
+  const char* file;
+  int line;
+  const char* signature = nullptr;
+  std::atomic<std::uint32_t> id = UNREGISTERED;
+};
+
+template <typename T>
+constexpr char tag() {
+  if constexpr (std::is_same_v<T, bool> || std::is_enum_v<T>) {
+    return 'i';
+  } else if constexpr (std::is_integral_v<T>) {
+    return std::is_signed_v<T> ? 'i' : 'u';
+  } else if constexpr (std::is_floating_point_v<T>) {
+    return 'd';
+  } else if constexpr (std::is_same_v<T, const char*> ||
+                       std::is_same_v<T, char*> ||
+                       std::is_same_v<T, std::string> ||
+                       std::is_same_v<T, std::string_view>) {
+    return 's';
+  } else if constexpr (std::is_pointer_v<T>) {
+    return 'p';
+  } else {
+    static_assert(!sizeof(T), "Unsupported binary log argument type");
+  }
+}
+
+template <typename... Args>
+inline constexpr char signature[sizeof...(Args) + 1] = {
+    tag<std::decay_t<Args>>()..., '\0'};
+
+/* Upper bound of an encoded entry: id, timestamp and the arguments, which
+ * take 8 bytes each or a 2 byte length plus up to MAX_STRING characters */
+template <typename... Args>
+inline constexpr std::size_t entry_size =
+    12U + (0U + ... + (tag<std::decay_t<Args>>() == 's' ? 2U + MAX_STRING
+                                                         : 8U));
+
+std::uint32_t register_site(Site& site, const char* signature);
+
+/* Copies an encoded entry (id, timestamp, arguments) into the calling
+ * thread's ring, counting it as dropped when the ring is full */
+void push(std::span<const std::uint8_t> entry);
+
+/* Starts the background writer; with an empty path entries are formatted and
+ * forwarded to logs::log, otherwise they are written to a binary log file */
+void start(std::string const& path = "");
+void flush();
+void stop();
+
+std::string format(std::string_view fmt, std::string_view signature,
+                   std::span<const std::uint8_t> args);
+
+struct Message {
+  LogLevel level;
+  std::uint64_t timestamp_ns;
+  std::string_view file;
+  int line;
+  std::string text;
+};
+
+class Decoder {
+ public:
+  explicit Decoder(std::string const& path);
+
+  /* Returns false at the end of the file */
+  bool next(Message& msg);
+  std::uint64_t dropped() const noexcept { return dropped_; }
+
+ private:
+  struct SiteInfo {
+    LogLevel level;
+    int line;
+    std::string fmt;
+    std::string file;
+    std::string signature;
+  };
+
+  std::string data_;
+  std::size_t pos_ = 0;
+  std::int64_t clock_offset_ = 0;
+  std::uint64_t dropped_ = 0;
+  std::uint64_t last_ns_ = 0;
+  std::vector<SiteInfo> sites_;
+};
+
+class Encoder {
+ public:
+  explicit Encoder(std::uint8_t* buf) : buf_{buf} {}
+
+  template <typename T>
+  void put(T const& value) {
+    using D = std::decay_t<T>;
+
+    if constexpr (tag<D>() == 's') {
+      std::string_view s{value};
+      auto len = static_cast<std::uint16_t>(std::min(s.size(), MAX_STRING));
+
+      raw(len);
+      std::memcpy(buf_ + pos_, s.data(), len);
+      pos_ += len;
+    } else if constexpr (tag<D>() == 'i') {
+      raw(static_cast<std::int64_t>(value));
+    } else if constexpr (tag<D>() == 'u') {
+      raw(static_cast<std::uint64_t>(value));
+    } else if constexpr (tag<D>() == 'd') {
+      raw(static_cast<double>(value));
+    } else {
+      raw(reinterpret_cast<std::uint64_t>(value));
+    }
+  }
+
+  template <typename T>
+  void raw(T value) {
+    std::memcpy(buf_ + pos_, &value, sizeof(T));
+    pos_ += sizeof(T);
+  }
+
+  std::size_t size() const noexcept { return pos_; }
+
+ private:
+  std::uint8_t* buf_;
+  std::size_t pos_ = 0;
+};
+
+template <typename... Args>
+inline void emit(Site& site, Args const&... args) {
+  std::uint32_t id = site.id.load(std::memory_order_acquire);
+
+  if (id == UNREGISTERED) id = register_site(site, signature<Args...>);
+
+  std::uint8_t buf[entry_size<Args...>];
+  Encoder enc{buf};
+
+  enc.raw(id);
+  enc.raw(static_cast<std::uint64_t>(
+      std::chrono::steady_clock::now().time_since_epoch().count()));
+  (enc.put(args), ...);
+
+  push({buf, enc.size()});
+}
+
+}  // namespace binlog
+
+}  // namespace logs
+
+#endif
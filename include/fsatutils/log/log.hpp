@@ -1,10 +1,30 @@
 #ifndef LOG_HPP_
 #define LOG_HPP_
 
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <cstdarg>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <iterator>
 #include <mutex>
+#include <source_location>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <version>
+
+#if __has_include(<format>)
+#include <format>
+#endif
+
+#ifndef __cpp_lib_format
+#include <ostream>
+#include <streambuf>
+#endif
 
 enum LogLevel {
   NONE = -1,
@@ -15,6 +35,43 @@ enum LogLevel {
   ERR,
 };
 
+/*
+ * Levels below FSATUTILS_LOG_FLOOR (e.g. -DFSATUTILS_LOG_FLOOR=INFO) are
+ * removed at compile time by the FSAT_LOG front end, arguments included.
+ */
+#ifndef FSATUTILS_LOG_FLOOR
+#define FSATUTILS_LOG_FLOOR LOG
+#endif
+
+/*
+ * FSAT_LOG(WARN, "{} overrun on {}", count, dev) formats with std::format
+ * syntax into a stack buffer once the level passed both the compile-time
+ * floor and global_log_level; filtered calls evaluate no arguments.
+ */
+#define FSAT_LOG(level, fmt, ...)                                        \
+  do {                                                                   \
+    if constexpr ((level) >= (FSATUTILS_LOG_FLOOR)) {                    \
+      if ((level) >= logs::global_log_level) {                           \
+        logs::print((level), std::source_location::current(),            \
+                    (fmt)__VA_OPT__(, ) __VA_ARGS__);                    \
+      }                                                                  \
+    }                                                                    \
+  } while (0)
+
+#define FSAT_DEBUG(...) FSAT_LOG(DEBUG, __VA_ARGS__)
+#define FSAT_INFO(...) FSAT_LOG(INFO, __VA_ARGS__)
+#define FSAT_WARN(...) FSAT_LOG(WARN, __VA_ARGS__)
+#define FSAT_ERR(...) FSAT_LOG(ERR, __VA_ARGS__)
+
+/*
+ * Messages are copied into a lock-free ring and written by a background
+ * thread that keeps the log file open and batches writes. The writer wakes up
+ * every flushInterval, or right away for messages at flushLevel or above,
+ * which are also synced to disk. Pending messages are drained on flush(),
+ * at exit and on fatal signals. ringSlots must be set before the first log;
+ * each slot takes about 500 bytes, and a full ring makes producers help the
+ * writer drain it rather than drop messages.
+ */
 namespace logs {
 constexpr inline const char* LOG_DIR = "/var/log/fsat/";
 inline std::string logFile;
@@ -23,35 +80,236 @@ inline bool disableFileLogs = false;
 inline bool coloredLogs = true;
 inline std::recursive_mutex logMutex;
 inline LogLevel global_log_level = DEBUG;
+inline std::size_t ringSlots = 256;
+inline std::chrono::milliseconds flushInterval{100};
+inline LogLevel flushLevel = ERR;
+/* Prefix FSAT_LOG messages with "file:line: " */
+inline bool sourceLocations = false;
+constexpr inline std::size_t FORMAT_BUFFER = 480U;
 
-void init(std::string logDir);
-void log(const LogLevel level, std::string str);
+/*
+ * A log file is rotated once it would grow past maxBytes or has been open for
+ * maxAge (0 disables it). Rotated files are renamed to
+ * <name>.<UTC timestamp>.log, gzipped by a low priority thread when built
+ * with zlib, and only the newest `keep` of them are retained.
+ */
+struct Rotation {
+  std::size_t maxBytes = 4U << 20U;
+  std::chrono::seconds maxAge{0};
+  std::size_t keep = 8;
+  bool compress = true;
+};
+
+/* Defaults for sinks created afterwards */
+inline Rotation rotation;
+/* Bound on all log files in the directory, oldest rotated files go first */
+inline std::uint64_t diskBudget = 64U << 20U;
+
+/*
+ * Formatted messages are limited per call site (format string) to `burst`
+ * every `period`, indexed by level; a burst of 0 disables the limit. Only
+ * WARN and ERR are limited by default, so an error loop (a failing recv, a
+ * flood of malformed messages) costs a counter increment per message instead
+ * of a format and a ring push, while regular output is left alone. The
+ * surplus is only counted, and reported as one message once the period is
+ * over or the backend stops. Identical consecutive lines of a sink are
+ * collapsed into "last message repeated N times", reported at the latest
+ * after repeatInterval.
+ */
+struct RateLimit {
+  std::uint32_t burst;
+  std::chrono::milliseconds period;
+};
+
+inline std::array<RateLimit, ERR + 1> rateLimits = {{
+    {0, std::chrono::seconds{1}},   // LOG
+    {0, std::chrono::seconds{1}},   // DEBUG
+    {0, std::chrono::seconds{1}},   // INFO
+    {50, std::chrono::seconds{1}},  // WARN
+    {50, std::chrono::seconds{1}},  // ERR
+}};
+inline bool collapseRepeats = true;
+inline std::chrono::seconds repeatInterval{10};
+
+/* Logs go to <logDir>/<service>.log, "fsat-sens" when no service is given */
+void init(std::string logDir, std::string service = "");
+void log(const LogLevel level, std::string_view str);
+void vlog(const LogLevel level, const char* fmt, va_list args);
+/* Rate limit check for the call site identified by its format string */
+bool admit(const LogLevel level, const char* fmt);
+void flush();
+void shutdown();
 
 inline void log(const LogLevel level, const char* fmt, ...) {
-  std::lock_guard<std::recursive_mutex> guard{logMutex};
-  std::string logMsg = "";
-  char* allocFmt;
   va_list args;
 
   if (level < global_log_level)
       return;
 
   va_start(args, fmt);
+  vlog(level, fmt, args);
+  va_end(args);
+}
 
-  if (vasprintf(&allocFmt, fmt, args) < 0) {
-    log(ERR, "Failed to allocated log string!!");
-    va_end(args);
+/*
+ * Messages logged through a component go to their own file,
+ * <logDir>/<service>-<name>.log, with its own rotation. Components are
+ * meant to be long-lived (e.g. static) and at most a few dozen may exist.
+ */
+class Component {
+ public:
+  explicit Component(std::string name)
+      : Component{std::move(name), rotation} {}
+  Component(std::string name, Rotation const& rotation);
+
+  void log(const LogLevel level, std::string_view str) const;
+  void log(const LogLevel level, const char* fmt, ...) const;
+
+ private:
+  std::uint16_t sink_;
+};
+
+namespace detail {
+
+inline std::size_t location(char* buf, std::size_t size,
+                            std::source_location const& loc) {
+  std::string_view file{loc.file_name()};
+  std::size_t slash = file.rfind('/');
+
+  if (slash != std::string_view::npos) file.remove_prefix(slash + 1U);
+
+  int n = std::snprintf(buf, size, "%.*s:%u: ", static_cast<int>(file.size()),
+                        file.data(), static_cast<unsigned>(loc.line()));
+
+  return n < 0 ? 0U : std::min(static_cast<std::size_t>(n), size - 1U);
+}
+
+#ifndef __cpp_lib_format
+/* Stand-in for toolchains without <format>: "{}" fields are filled in order
+ * through operator<<, "{{" / "}}" are escapes. Format specs and a field
+ * count not matching the arguments are rejected at compile time */
+template <typename... Args>
+struct PlainFormat {
+  template <std::size_t N>
+  consteval PlainFormat(const char (&s)[N]) : str{s, N - 1U} {
+    std::size_t fields = 0;
+
+    for (std::size_t i = 0; i < str.size(); i++) {
+      char c = str[i];
+
+      if (c != '{' && c != '}') continue;
+
+      if (i + 1U < str.size() && str[i + 1U] == c) {
+        i++;
+      } else if (c == '{' && i + 1U < str.size() && str[i + 1U] == '}') {
+        fields++;
+        i++;
+      } else {
+        throw "format specs need <format>, use \"{}\"";
+      }
+    }
+
+    if (fields != sizeof...(Args)) {
+      throw "format fields do not match the arguments";
+    }
+  }
+
+  std::string_view str;
+};
+
+class StackBuf : public std::streambuf {
+ public:
+  StackBuf(char* begin, char* end) { setp(begin, end); }
+  std::size_t size() const {
+    return static_cast<std::size_t>(pptr() - pbase());
+  }
+};
+
+inline void copy_literal(std::ostream& os, std::string_view& fmt) {
+  while (!fmt.empty()) {
+    std::size_t pos = fmt.find_first_of("{}");
+
+    os << fmt.substr(0, pos);
+
+    if (pos == std::string_view::npos) {
+      fmt = {};
+      return;
+    }
+
+    if (pos + 1U < fmt.size() && fmt[pos + 1U] == fmt[pos]) {
+      os << fmt[pos];
+      fmt.remove_prefix(pos + 2U);
+      continue;
+    }
+
+    fmt.remove_prefix(pos);
+
+    if (fmt.front() == '{') return;
+
+    os << '}';
+    fmt.remove_prefix(1U);
+  }
+}
+
+template <typename T>
+void format_arg(std::ostream& os, std::string_view& fmt, T const& arg) {
+  copy_literal(os, fmt);
+
+  if (fmt.empty()) return;
+
+  std::size_t close = fmt.find('}');
+
+  fmt.remove_prefix(close == std::string_view::npos ? fmt.size() : close + 1U);
+  os << arg;
+}
+#endif
+
+}  // namespace detail
+
+#ifdef __cpp_lib_format
+template <typename... Args>
+void print(const LogLevel level, std::source_location const& loc,
+           std::format_string<Args...> fmt, Args&&... args) {
+  if (!admit(level, fmt.get().data())) return;
+
+  char buf[FORMAT_BUFFER];
+  std::size_t len = sourceLocations ? detail::location(buf, sizeof(buf), loc)
+                                    : 0U;
+  auto res = std::format_to_n(buf + len, sizeof(buf) - len, fmt,
+                              std::forward<Args>(args)...);
+
+  if (static_cast<std::size_t>(res.size) <= sizeof(buf) - len) {
+    log(level, std::string_view{buf, len + static_cast<std::size_t>(res.size)});
     return;
   }
 
-  va_end(args);
+  std::string text{buf, len};
 
-  logMsg += allocFmt;
+  std::format_to(std::back_inserter(text), fmt, std::forward<Args>(args)...);
+  log(level, text);
+}
+#else
+template <typename... Args>
+void print(const LogLevel level, std::source_location const& loc,
+           detail::PlainFormat<std::type_identity_t<Args>...> format,
+           Args&&... args) {
+  std::string_view fmt = format.str;
 
-  free(allocFmt);
+  if (!admit(level, fmt.data())) return;
 
-  log(level, logMsg);
+  char buf[FORMAT_BUFFER];
+  std::size_t len = sourceLocations ? detail::location(buf, sizeof(buf), loc)
+                                    : 0U;
+  detail::StackBuf sb{buf + len, buf + sizeof(buf)};
+  std::ostream os{&sb};
+
+  (detail::format_arg(os, fmt, args), ...);
+  detail::copy_literal(os, fmt);
+
+  /* Longer messages are truncated to the buffer */
+  log(level, std::string_view{buf, len + sb.size()});
 }
+#endif
 
 }  // namespace logs
 
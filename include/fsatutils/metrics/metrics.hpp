@@ -0,0 +1,199 @@
+#ifndef METRICS_HPP_
+#define METRICS_HPP_
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <string_view>
+
+namespace fsatutils {
+
+namespace metrics {
+
+inline constexpr std::size_t SHARDS = 8U;
+
+/* Each thread updates its own cache line, readers sum the shards */
+std::size_t shard() noexcept;
+
+class Counter {
+ public:
+  void add(std::uint64_t n = 1U) noexcept {
+    shards_[shard()].value.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  std::uint64_t value() const noexcept;
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<std::uint64_t> value = 0;
+  };
+
+  std::array<Shard, SHARDS> shards_;
+};
+
+class Gauge {
+ public:
+  void set(std::int64_t v) noexcept {
+    value_.store(v, std::memory_order_relaxed);
+  }
+
+  void add(std::int64_t n) noexcept {
+    value_.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  std::int64_t value() const noexcept {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<std::int64_t> value_ = 0;
+};
+
+struct HistogramSnapshot {
+  std::uint64_t count;
+  std::uint64_t sum;
+  std::uint64_t min;
+  std::uint64_t max;
+  std::uint64_t p50;
+  std::uint64_t p90;
+  std::uint64_t p99;
+  std::uint64_t p999;
+};
+
+/*
+ * Log-linear (HDR-style) histogram of unsigned values, e.g. nanoseconds.
+ * Every power of two is split into 2^SUB_BITS linear buckets, bounding the
+ * relative error of percentiles to 1/2^SUB_BITS; values above MAX_VALUE are
+ * clamped. Recording is a few relaxed atomic adds on the thread's shard.
+ */
+template <std::size_t Shards>
+class BasicHistogram {
+ public:
+  static constexpr unsigned SUB_BITS = 4U;
+  static constexpr unsigned MAX_EXPONENT = 40U;
+  static constexpr std::uint64_t MAX_VALUE =
+      (std::uint64_t{1} << (MAX_EXPONENT + 1U)) - 1U;
+  static constexpr std::size_t BUCKETS =
+      (MAX_EXPONENT - SUB_BITS + 2U) << SUB_BITS;
+
+  void record(std::uint64_t v) noexcept {
+    Shard& s = shards_[Shards == 1U ? 0U : shard()];
+
+    v = v > MAX_VALUE ? MAX_VALUE : v;
+
+    s.counts[bucket(v)].fetch_add(1U, std::memory_order_relaxed);
+    s.count.fetch_add(1U, std::memory_order_relaxed);
+    s.sum.fetch_add(v, std::memory_order_relaxed);
+
+    std::uint64_t cur = s.min.load(std::memory_order_relaxed);
+    while (v < cur && !s.min.compare_exchange_weak(cur, v,
+                                                   std::memory_order_relaxed)) {
+    }
+
+    cur = s.max.load(std::memory_order_relaxed);
+    while (v > cur && !s.max.compare_exchange_weak(cur, v,
+                                                   std::memory_order_relaxed)) {
+    }
+  }
+
+  HistogramSnapshot snapshot() const;
+
+  static constexpr std::size_t bucket(std::uint64_t v) noexcept {
+    if (v < (std::uint64_t{1} << SUB_BITS)) return static_cast<std::size_t>(v);
+
+    unsigned e = static_cast<unsigned>(std::bit_width(v)) - 1U;
+    std::uint64_t sub = (v >> (e - SUB_BITS)) & ((1U << SUB_BITS) - 1U);
+
+    return (static_cast<std::size_t>(e - SUB_BITS + 1U) << SUB_BITS) + sub;
+  }
+
+  /* Largest value that lands in bucket i */
+  static constexpr std::uint64_t upper_bound(std::size_t i) noexcept {
+    if (i < (std::size_t{1} << SUB_BITS)) return i;
+
+    unsigned e = static_cast<unsigned>(i >> SUB_BITS) + SUB_BITS - 1U;
+    std::uint64_t sub = i & ((1U << SUB_BITS) - 1U);
+    std::uint64_t low = (std::uint64_t{1} << e) | (sub << (e - SUB_BITS));
+
+    return low + (std::uint64_t{1} << (e - SUB_BITS)) - 1U;
+  }
+
+ private:
+  struct alignas(64) Shard {
+    std::array<std::atomic<std::uint64_t>, BUCKETS> counts{};
+    std::atomic<std::uint64_t> count = 0;
+    std::atomic<std::uint64_t> sum = 0;
+    std::atomic<std::uint64_t> min = ~std::uint64_t{0};
+    std::atomic<std::uint64_t> max = 0;
+  };
+
+  std::array<Shard, Shards> shards_;
+};
+
+using Histogram = BasicHistogram<SHARDS>;
+
+/* Unsharded, a fraction of the size, for values recorded by one thread at
+ * a time; any thread may still take snapshots */
+using LocalHistogram = BasicHistogram<1U>;
+
+/* Records the lifetime of the scope in nanoseconds */
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(Histogram& h) noexcept
+      : hist_{h}, start_{std::chrono::steady_clock::now()} {}
+
+  ~ScopedTimer() {
+    hist_.record(static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_)
+            .count()));
+  }
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+ private:
+  Histogram& hist_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+/*
+ * Named metrics. Lookups take a lock and are meant to happen once, e.g. when
+ * a component is constructed; the returned references stay valid for the
+ * registry's lifetime and updating them never locks.
+ */
+class Registry {
+ public:
+  Counter& counter(std::string_view name);
+  Gauge& gauge(std::string_view name);
+  Histogram& histogram(std::string_view name);
+
+  /* {"counters": {...}, "gauges": {...}, "histograms": {name: {"count",
+   * "sum", "min", "max", "p50", "p90", "p99", "p999"}}} */
+  nlohmann::json snapshot() const;
+
+  /* Process-wide registry used by the library's own instrumentation */
+  static Registry& global();
+
+ private:
+  template <typename T>
+  using Map = std::map<std::string, std::unique_ptr<T>, std::less<>>;
+
+  mutable std::mutex mtx_;
+  Map<Counter> counters_;
+  Map<Gauge> gauges_;
+  Map<Histogram> histograms_;
+};
+
+}  // namespace metrics
+
+}  // namespace fsatutils
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef STORE_HPP_
+#define STORE_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <fsatutils/iio/capture.hpp>
+#include <fsatutils/iio/sampler.hpp>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fsatutils {
+
+namespace store {
+
+class Segment;
+
+struct Slice {
+  std::span<const std::uint64_t> timestamps;
+  std::span<const double> values;
+};
+
+/* Result of a range query: slices point straight into the mapped segments,
+ * which the Range keeps mapped for as long as it lives. */
+class Range {
+ public:
+  std::vector<Slice> const& slices() const noexcept { return slices_; }
+  std::size_t size() const noexcept;
+
+  auto begin() const noexcept { return slices_.begin(); }
+  auto end() const noexcept { return slices_.end(); }
+
+ private:
+  friend class Store;
+
+  std::vector<std::shared_ptr<const Segment>> segments_;
+  std::vector<Slice> slices_;
+};
+
+struct Bucket {
+  std::uint64_t start_ns;
+  std::uint64_t count;
+  double min;
+  double max;
+  double mean;
+};
+
+/*
+ * Local time-series store. Every series (e.g. "dev0/voltage0/raw") lives in
+ * its own directory as a sequence of fixed-capacity segment files holding a
+ * timestamp column, a value column and min/max/sum summaries of every
+ * SUMMARY_BLOCK samples. Segments are memory-mapped, so queries return spans
+ * without copying, and rollups use the summaries for blocks that fall inside
+ * a single bucket. Timestamps of a series must not decrease.
+ */
+class Store {
+ public:
+  static constexpr std::size_t SUMMARY_BLOCK = 1024U;
+
+  explicit Store(std::string dir, std::size_t segment_samples = 1U << 20U);
+  ~Store();
+
+  bool append(std::string_view series, std::uint64_t ts, double value);
+  std::size_t append(std::string_view series,
+                     std::span<const std::uint64_t> ts,
+                     std::span<const double> values);
+
+  /* Samples with from <= timestamp < to */
+  Range query(std::string_view series, std::uint64_t from, std::uint64_t to);
+  std::vector<Bucket> rollup(std::string_view series, std::uint64_t from,
+                             std::uint64_t to, std::uint64_t bucket_ns);
+
+  std::vector<std::string> series() const;
+  void flush();
+
+  /* Samples refused because they were older than the end of their series */
+  std::uint64_t rejected() const noexcept {
+    return rejected_.load(std::memory_order_relaxed);
+  }
+
+  /* Sinks appending numeric sampler results as "device/channel/attr" and
+   * capture frames as one series per channel. Sampler results are stamped
+   * with their wall-clock time, since the steady clock restarts on reboot.
+   * Capture series are grouped per device in the order the devices were
+   * added; gap samples are skipped. */
+  iio::Sampler::Callback sampler_sink();
+  iio::CaptureGroup::FrameCallback capture_sink(
+      std::vector<std::vector<std::string>> series);
+
+  Store(const Store&) = delete;
+  Store& operator=(const Store&) = delete;
+  Store(Store&&) = delete;
+  Store& operator=(Store&&) = delete;
+
+ private:
+  class Series;
+
+  Series* find(std::string_view name, bool create);
+
+  std::string dir_;
+  std::size_t segment_samples_;
+  mutable std::shared_mutex mtx_;
+  std::map<std::string, std::unique_ptr<Series>, std::less<>> series_;
+  std::atomic<std::uint64_t> rejected_ = 0;
+};
+
+}  // namespace store
+
+}  // namespace fsatutils
+
+#endif
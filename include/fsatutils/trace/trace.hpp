@@ -0,0 +1,102 @@
+#ifndef TRACE_HPP_
+#define TRACE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace fsatutils {
+
+namespace trace {
+
+/* Events kept per thread; older ones are overwritten */
+inline constexpr std::size_t RING_EVENTS = 4096U;
+
+struct Event {
+  const char* name;
+  const char* category;
+  std::uint64_t start_ns;
+  std::uint64_t dur_ns;
+  std::uint64_t trace_id;
+};
+
+namespace detail {
+inline std::atomic<bool> enabled = false;
+inline thread_local std::uint64_t current = 0;
+}  // namespace detail
+
+inline bool enabled() noexcept {
+  return detail::enabled.load(std::memory_order_relaxed);
+}
+
+inline void enable(bool on = true) noexcept {
+  detail::enabled.store(on, std::memory_order_relaxed);
+}
+
+/* Monotonic clock shared by every process on the host, so client and
+ * service traces line up when loaded together */
+inline std::uint64_t now_ns() noexcept {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+/* Trace ID that spans ending on this thread are tagged with */
+inline std::uint64_t current_id() noexcept { return detail::current; }
+
+std::uint64_t new_trace_id();
+void record(Event const& event);
+
+/* Sets the calling thread's trace ID for the duration of the scope */
+class TraceScope {
+ public:
+  explicit TraceScope(std::uint64_t id) noexcept : prev_{detail::current} {
+    detail::current = id;
+  }
+
+  ~TraceScope() { detail::current = prev_; }
+
+  /* For IDs only known part way through the scope */
+  void set(std::uint64_t id) noexcept { detail::current = id; }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+ private:
+  std::uint64_t prev_;
+};
+
+/* Times its scope when tracing is enabled; names must be string literals */
+class Span {
+ public:
+  explicit Span(const char* name, const char* category = "fsat") noexcept
+      : name_{name}, category_{category}, start_{enabled() ? now_ns() : 0U} {}
+
+  ~Span() {
+    if (start_ != 0U) {
+      record({name_, category_, start_, now_ns() - start_, current_id()});
+    }
+  }
+
+  Span(const Span&) = delete;
+  Span& operator=(const Span&) = delete;
+
+ private:
+  const char* name_;
+  const char* category_;
+  std::uint64_t start_;
+};
+
+/* Chrome trace-event JSON of the recorded events, for chrome://tracing or
+ * Perfetto; spans carry their trace ID as args.trace_id */
+std::string export_json();
+bool export_json(std::string const& path);
+void clear();
+
+}  // namespace trace
+
+}  // namespace fsatutils
+
+#endif
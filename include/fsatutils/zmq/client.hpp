@@ -1,8 +1,11 @@
 #ifndef CLIENT_HPP_
 #define CLIENT_HPP_
 
+#include <cstdint>
 #include <memory>
 #include <span>
+#include <string>
+#include <string_view>
 #include <vector>
 
 namespace fsatutils {
@@ -21,10 +24,45 @@ class Client {
     std::vector<CommandArg> args;
   };
 
+  /*
+   * A command whose service, name and argument names are encoded once by
+   * prepare(); only the values are escaped and copied on each send, for
+   * callers that fire the same command at high rates.
+   */
+  class PreparedCommand {
+   public:
+    /* Values follow the order of the names given to prepare() */
+    void set(std::size_t arg, std::string_view value) {
+      values_.at(arg).assign(value);
+    }
+
+    std::size_t size() const noexcept { return values_.size(); }
+
+   private:
+    friend class Client;
+
+    std::string service_;
+    /* Encoded JSON around each value, one more than there are values */
+    std::vector<std::string> segments_;
+    std::vector<std::string> values_;
+  };
+
   Client(std::string host);
   ~Client();
 
+  /*
+   * Command header version to send. Defaults to the 2-byte v1 header, which
+   * every service accepts; switch to 2 once all services are upgraded to get
+   * trace IDs, sequence numbers and latency tracking.
+   */
+  void setHeaderVersion(std::uint8_t version) noexcept;
+
+  static PreparedCommand prepare(std::string_view service,
+                                 std::string_view name,
+                                 std::vector<std::string> const& argNames);
+
   bool sendCommand(std::string_view service, Client::CommandRequest& req);
+  bool send(PreparedCommand const& cmd);
   bool sendDiscover();
   bool recvAndLogResponses();
   bool publishRawBytes(std::string_view topic, std::span<std::uint8_t> data);
@@ -1,20 +1,66 @@
 #ifndef SERVICE_HPP_
 #define SERVICE_HPP_
 
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <fsatutils/metrics/metrics.hpp>
 #include <functional>
 #include <memory>
 #include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
 #include <vector>
 
+#include "typed_command.hpp"
 #include "zprotocol.hpp"
 
 namespace fsatutils {
 
 namespace zmq {
 
+/* Queued commands run highest class first, in arrival order within a
+ * class */
+enum class Priority : std::uint8_t { CRITICAL, HIGH, NORMAL, LOW };
+
+/* deadline is measured from reception; a command still queued past it is
+ * counted and logged, and dropped when dropLate is set. With conflate, a
+ * newer message replaces a queued one of the same command or topic in its
+ * place, so only the latest is ever waiting. Options given when a command
+ * is first registered apply to all its handlers */
+struct CommandOptions {
+  Priority priority = Priority::NORMAL;
+  std::optional<std::chrono::milliseconds> deadline = std::nullopt;
+  bool dropLate = true;
+  bool conflate = false;
+};
+
+/* What happens to a message that arrives while the ingress queue is full */
+enum class Overflow : std::uint8_t {
+  /* Stop reading, ZMQ buffers messages up to its high water mark */
+  BLOCK,
+  /* Evict the oldest message of the lowest class queued, unless that class
+   * is above the new message's; then the new one is dropped */
+  DROP_OLDEST,
+  DROP_NEWEST,
+};
+
+struct IngressOptions {
+  std::size_t capacity = 16U;
+  Overflow overflow = Overflow::BLOCK;
+};
+
 class Service {
  public:
-  using CommandHandlerFn = std::function<void(void*, Command)>;
+  /* The Command is only valid during the call, see Command */
+  using CommandHandlerFn = std::function<void(void*, Command const&)>;
+
+  /* Called with each message published on a subscribed topic; both views
+   * are only valid during the call */
+  using TopicHandlerFn =
+      std::function<void(std::string_view, std::span<const std::uint8_t>)>;
 
   struct ServiceDescription {
     std::string name;
@@ -23,6 +69,18 @@ class Service {
     uint8_t preferedProtocol;
   };
 
+  /* Per-sender view of v2 command headers. lost counts sequence gaps, late
+   * counts commands at or below the last sequence seen (duplicates or
+   * reordering) */
+  struct SenderStats {
+    std::uint64_t sender;
+    std::uint64_t received;
+    std::uint64_t lost;
+    std::uint64_t late;
+    std::uint64_t lastSeq;
+    metrics::HistogramSnapshot latencyNs;
+  };
+
   Service(ServiceDescription desc);
   ~Service();
 
@@ -32,15 +90,102 @@ class Service {
   Service& registerCommand(
       CommandType command, std::vector<CommandArg> args,
       std::optional<CommandHandlerFn> handler = std::nullopt,
-      std::optional<void*> handlerData = std::nullopt);
+      std::optional<void*> handlerData = std::nullopt,
+      CommandOptions options = {});
 
   bool registerHandler(CommandType& command, CommandHandlerFn handler,
                        void* handlerData);
 
+  /* Identifies one handler added by addHandler(), false if it could not be
+   * added */
+  struct HandlerHandle {
+    CommandType command;
+    std::uint64_t id;
+
+    explicit operator bool() const noexcept { return id != 0U; }
+  };
+
+  /* Like registerHandler(), for handlers that are removed again */
+  HandlerHandle addHandler(CommandType& command, CommandHandlerFn handler,
+                           void* handlerData);
+
+  /* Removes just that handler, e.g. when a plug-in unloads; the command and
+   * its other handlers stay */
+  bool unregisterHandler(HandlerHandle const& handle);
+
+  /* Removes the command and all its handlers. Registration may happen at any
+   * time, including while the service runs and from within handlers;
+   * commands being dispatched finish with the handlers they started with */
+  bool unregisterCommand(std::string_view command);
+
+  /* Registers a command whose arguments are Args::fields, see
+   * typed_command.hpp. handler is called with the decoded struct, or not at
+   * all if an argument is missing or malformed */
+  template <CommandStruct Args, std::invocable<Args const&> Handler>
+  Service& registerCommand(CommandType command, Handler handler,
+                           CommandOptions options = {}) {
+    std::vector<CommandArg> args;
+
+    for (auto const& spec : schemaOf<Args>) {
+      args.push_back({.name = std::string{spec.name},
+                      .value = {},
+                      .type = spec.type,
+                      .optional = spec.optional});
+    }
+
+    TypedHandler typed = {
+        .invoke = [](void* fn, Command const& cmd,
+                     std::string_view& bad) -> bool {
+          Args decoded{};
+
+          if (!decodeCommand(cmd, decoded, bad)) return false;
+
+          (*static_cast<Handler*>(fn))(std::as_const(decoded));
+
+          return true;
+        },
+        .callable = std::make_shared<Handler>(std::move(handler)),
+    };
+
+    return registerTyped(std::move(command), std::move(args),
+                         std::move(typed), options);
+  }
+
   bool publishRawBytes(std::string_view topic, std::span<std::uint8_t> data);
+  /* May be called while the service runs; the receiver thread then applies
+   * the subscription, within a receive timeout */
   bool subscribeTo(std::string_view topic);
 
+  /* Messages whose topic starts with topic are queued and passed to handler
+   * like commands are, the longest matching subscription wins */
+  bool subscribeTo(std::string_view topic, TopicHandlerFn handler,
+                   CommandOptions options = {});
+
+  /* Publishes a metrics snapshot on "stats/<name>" every interval, on top of
+   * the built-in "stats" command; set before runService(), 0 disables it */
+  void publishStats(std::chrono::milliseconds interval);
+
+  /* Bounds the messages received but not yet handled; set before
+   * runService() */
+  void setIngress(IngressOptions options);
+
+  /* Also published as "senders" in the stats snapshot */
+  std::vector<SenderStats> senderStats() const;
+
+  /* This service's own metrics, the ones its stats snapshot reports */
+  metrics::Registry& metrics();
+
  private:
+  /* Type-erased by registerCommand<Args>; invoke decodes and calls the
+   * handler directly, without a std::function */
+  struct TypedHandler {
+    bool (*invoke)(void* fn, Command const& cmd, std::string_view& bad);
+    std::shared_ptr<void> callable;
+  };
+
+  Service& registerTyped(CommandType command, std::vector<CommandArg> args,
+                         TypedHandler handler, CommandOptions options);
+
   class impl;
   std::unique_ptr<impl> impl_;
 };
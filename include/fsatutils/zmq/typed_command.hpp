@@ -0,0 +1,194 @@
+#ifndef TYPED_COMMAND_HPP_
+#define TYPED_COMMAND_HPP_
+
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "zprotocol.hpp"
+
+namespace fsatutils {
+
+namespace zmq {
+
+/*
+ * Typed commands declare their arguments as a struct listing its fields:
+ *
+ *   struct SetGain {
+ *     std::int32_t gain;
+ *     std::optional<std::string_view> channel;
+ *
+ *     static constexpr auto fields =
+ *         std::make_tuple(zmq::field("gain", &SetGain::gain),
+ *                         zmq::field("channel", &SetGain::channel));
+ *   };
+ *
+ * Integer fields map to the matching ArgType, std::string and
+ * std::string_view to STRING, and std::optional<T> marks an optional
+ * argument. string_view fields point into the received message and are only
+ * valid during the handler call.
+ */
+template <typename Struct, typename T>
+struct Field {
+  using type = T;
+
+  std::string_view name;
+  T Struct::*member;
+};
+
+template <typename Struct, typename T>
+constexpr Field<Struct, T> field(std::string_view name, T Struct::*member) {
+  return {name, member};
+}
+
+struct ArgSpec {
+  std::string_view name;
+  ArgType type;
+  bool optional;
+};
+
+namespace detail {
+
+template <typename T>
+struct ArgTypeOf;
+
+template <>
+struct ArgTypeOf<std::int8_t> {
+  static constexpr ArgType value = ArgType::INT8;
+};
+
+template <>
+struct ArgTypeOf<std::uint8_t> {
+  static constexpr ArgType value = ArgType::UINT8;
+};
+
+template <>
+struct ArgTypeOf<std::int16_t> {
+  static constexpr ArgType value = ArgType::INT16;
+};
+
+template <>
+struct ArgTypeOf<std::uint16_t> {
+  static constexpr ArgType value = ArgType::UINT16;
+};
+
+template <>
+struct ArgTypeOf<std::int32_t> {
+  static constexpr ArgType value = ArgType::INT32;
+};
+
+template <>
+struct ArgTypeOf<std::uint32_t> {
+  static constexpr ArgType value = ArgType::UINT32;
+};
+
+template <>
+struct ArgTypeOf<std::int64_t> {
+  static constexpr ArgType value = ArgType::INT64;
+};
+
+template <>
+struct ArgTypeOf<std::uint64_t> {
+  static constexpr ArgType value = ArgType::UINT64;
+};
+
+template <>
+struct ArgTypeOf<std::string> {
+  static constexpr ArgType value = ArgType::STRING;
+};
+
+template <>
+struct ArgTypeOf<std::string_view> {
+  static constexpr ArgType value = ArgType::STRING;
+};
+
+template <typename T>
+struct ArgTypeOf<std::optional<T>> : ArgTypeOf<T> {};
+
+template <typename T>
+inline constexpr bool is_optional = false;
+
+template <typename T>
+inline constexpr bool is_optional<std::optional<T>> = true;
+
+template <typename T>
+bool decodeValue(std::string_view s, T& out) {
+  if constexpr (std::is_integral_v<T>) {
+    const char* end = s.data() + s.size();
+    auto [p, ec] = std::from_chars(s.data(), end, out);
+
+    return ec == std::errc{} && p == end;
+  } else {
+    out = T{s};
+    return true;
+  }
+}
+
+template <typename Struct, typename T>
+bool decodeField(Command const& cmd, Struct& out, Field<Struct, T> const& f,
+                 std::string_view& bad) {
+  auto value = cmd.arg(f.name);
+
+  if constexpr (is_optional<T>) {
+    if (!value.has_value()) return true;
+
+    typename T::value_type v{};
+
+    if (!decodeValue(*value, v)) {
+      bad = f.name;
+      return false;
+    }
+
+    out.*f.member = std::move(v);
+  } else {
+    if (!value.has_value() || !decodeValue(*value, out.*f.member)) {
+      bad = f.name;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace detail
+
+template <typename T>
+concept CommandStruct = std::is_default_constructible_v<T> && requires {
+  std::tuple_size<std::remove_cvref_t<decltype(T::fields)>>::value;
+};
+
+/* The schema of T, as published in the service description */
+template <CommandStruct T>
+inline constexpr auto schemaOf = std::apply(
+    [](auto const&... f) {
+      return std::array<ArgSpec, sizeof...(f)>{ArgSpec{
+          f.name,
+          detail::ArgTypeOf<typename std::remove_cvref_t<decltype(f)>::type>::
+              value,
+          detail::is_optional<
+              typename std::remove_cvref_t<decltype(f)>::type>}...};
+    },
+    T::fields);
+
+/* Fills out from cmd; on failure bad names the missing or malformed
+ * argument. Arguments not in the schema are ignored */
+template <CommandStruct T>
+bool decodeCommand(Command const& cmd, T& out, std::string_view& bad) {
+  return std::apply(
+      [&](auto const&... f) {
+        return (detail::decodeField(cmd, out, f, bad) && ...);
+      },
+      T::fields);
+}
+
+}  // namespace zmq
+
+}  // namespace fsatutils
+
+#endif
@@ -1,7 +1,9 @@
 #ifndef ZPROTOCOL_HPP_
 #define ZPROTOCOL_HPP_
 
+#include <chrono>
 #include <cstdint>
+#include <memory_resource>
 #include <nlohmann/json.hpp>
 #include <optional>
 #include <span>
@@ -42,11 +44,27 @@ struct DiscoverMsgHeader {
   uint8_t version;
 };
 
+/*
+ * v1 is {version, proto}. v2 appends, little-endian:
+ *   [2] flags u16, [4] reserved u32, [8] sender u64, [16] seq u64,
+ *   [24] sendNs u64, [32] traceId u64
+ * seq counts from 1 per sender and destination service, so gaps mean lost
+ * commands. sendNs is the sender's CLOCK_MONOTONIC, only comparable on the
+ * same host.
+ */
 struct CommandMsgHeader {
   uint8_t version;
   MessageProtocol proto;
+  uint16_t flags = 0;
+  uint64_t sender = 0;
+  uint64_t seq = 0;
+  uint64_t sendNs = 0;
+  uint64_t traceId = 0;
 };
 
+inline constexpr std::size_t COMMAND_HEADER_V1_SIZE = 2U;
+inline constexpr std::size_t COMMAND_HEADER_V2_SIZE = 40U;
+
 using CommandType = std::string;
 
 struct CommandArg {
@@ -56,9 +74,34 @@ struct CommandArg {
   bool optional;
 };
 
+/* Decoded argument, see Command */
+struct ArgView {
+  std::string_view name;
+  std::string_view value;
+};
+
+/*
+ * A decoded command. Its strings and argument list live in the memory
+ * resource it was decoded into, the service's per-message arena, so a
+ * Command is only valid for the duration of the handler call; copy out
+ * anything that must outlive it.
+ */
 struct Command {
-  std::string cmd;
-  std::vector<CommandArg> args;
+  explicit Command(
+      std::pmr::memory_resource* mr = std::pmr::get_default_resource())
+      : args{mr} {}
+
+  std::optional<std::string_view> arg(std::string_view name) const noexcept {
+    for (auto const& a : args) {
+      if (a.name == name) return a.value;
+    }
+    return std::nullopt;
+  }
+
+  std::string_view cmd;
+  std::pmr::vector<ArgView> args;
+  /* From the v2 header, 0 for v1 messages */
+  std::uint64_t traceId = 0;
 };
 
 inline constexpr std::string_view protoToString(MessageProtocol proto) {
@@ -114,37 +157,97 @@ inline constexpr std::optional<ArgType> stringToType(
   return std::nullopt;
 }
 
-using json = nlohmann::json;
+/* Clock for CommandMsgHeader::sendNs */
+inline std::uint64_t sendClockNs() noexcept {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
 
-inline std::optional<Command> parseJSON(std::span<const uint8_t> command) {
-  Command cmd;
+namespace detail {
 
-  try {
-    json j = json::parse(command);
+inline void putLE(std::uint8_t* p, std::uint64_t v, std::size_t n) noexcept {
+  for (std::size_t i = 0; i < n; i++) {
+    p[i] = static_cast<std::uint8_t>(v >> (8U * i));
+  }
+}
 
-    cmd.cmd = j["command"];
+inline std::uint64_t getLE(const std::uint8_t* p, std::size_t n) noexcept {
+  std::uint64_t v = 0;
 
-    for (auto const& arg : j["args"]) {
-      CommandArg a{};
+  for (std::size_t i = 0; i < n; i++) v |= std::uint64_t{p[i]} << (8U * i);
 
-      a.name = arg["name"];
-      a.value = arg["value"];
+  return v;
+}
 
-      cmd.args.push_back(a);
-    }
+}  // namespace detail
 
-  } catch (const json::parse_error& e) {
-    logs::log(ERR, "Failed to parse JSON message: %s\n", e.what());
-    return std::nullopt;
-  } catch (const std::exception& e) {
-    logs::log(ERR, "Exception raised in parsing JSON message: %s\n", e.what());
-    return std::nullopt;
+/* Returns the encoded size, the v1 layout is used for version 1 */
+inline std::size_t encodeHeader(
+    CommandMsgHeader const& h,
+    std::span<std::uint8_t, COMMAND_HEADER_V2_SIZE> out) noexcept {
+  out[0] = h.version;
+  out[1] = static_cast<std::uint8_t>(h.proto);
+
+  if (h.version < 2U) return COMMAND_HEADER_V1_SIZE;
+
+  detail::putLE(&out[2], h.flags, 2U);
+  detail::putLE(&out[4], 0U, 4U);
+  detail::putLE(&out[8], h.sender, 8U);
+  detail::putLE(&out[16], h.seq, 8U);
+  detail::putLE(&out[24], h.sendNs, 8U);
+  detail::putLE(&out[32], h.traceId, 8U);
+
+  return COMMAND_HEADER_V2_SIZE;
+}
+
+/* Accepts v1 and v2 headers; a v2+ header may be longer than we know about,
+ * trailing fields are ignored */
+inline std::optional<CommandMsgHeader> decodeHeader(
+    std::span<const std::uint8_t> in) noexcept {
+  if (in.size() < COMMAND_HEADER_V1_SIZE) return std::nullopt;
+
+  CommandMsgHeader h = {
+      .version = in[0],
+      .proto = static_cast<MessageProtocol>(in[1]),
+  };
+
+  if (h.version < 2U) {
+    if (in.size() != COMMAND_HEADER_V1_SIZE) return std::nullopt;
+    return h;
   }
 
-  return cmd;
-};
+  if (in.size() < COMMAND_HEADER_V2_SIZE) return std::nullopt;
+
+  h.flags = static_cast<std::uint16_t>(detail::getLE(&in[2], 2U));
+  h.sender = detail::getLE(&in[8], 8U);
+  h.seq = detail::getLE(&in[16], 8U);
+  h.sendNs = detail::getLE(&in[24], 8U);
+  h.traceId = detail::getLE(&in[32], 8U);
+
+  return h;
+}
+
+using json = nlohmann::json;
+
+/*
+ * Decodes {"command": "...", "args": [{"name": "...", "value": "..."}]}
+ * in a single pass, without building a DOM. Other keys are skipped, and
+ * parsing stops at the first syntax or schema error. Strings without escapes
+ * are views into command, which must outlive the result; anything else is
+ * allocated from mr and never freed individually, so mr should be an arena
+ * such as std::pmr::monotonic_buffer_resource.
+ */
+std::optional<Command> parseJSON(std::span<const uint8_t> command,
+                                 std::pmr::memory_resource* mr);
+
+/* Appends s as a quoted, escaped JSON string */
+void appendJSONString(std::string& out, std::string_view s);
 
 inline std::string_view g_discoverTopic = "disc";
+inline std::string_view g_statsTopic = "stats/";
+inline std::string_view g_statsCommand = "stats";
 
 }  // namespace zmq
 
@@ -129,16 +129,21 @@ int ArgpHandler::default_parser(int key, char* arg, argp_state* state) {
       printf("%s version %s\n", handler->config.program_name,
              handler->config.program_version);
       exit(0);
-    case 'l':
+    case 'l': {
+      const char* service = handler->config.program_name != nullptr
+                                ? handler->config.program_name
+                                : "";
+
       if (arg != nullptr) {
         std::string log_dir{arg};
         logs::log(INFO, "Initializing logs in dir [%s]...\n", log_dir.c_str());
-        logs::init(log_dir);
+        logs::init(log_dir, service);
       } else {
         logs::log(INFO, "Initializing logs in dir [%s]...\n", logs::LOG_DIR);
-        logs::init(logs::LOG_DIR);
+        logs::init(logs::LOG_DIR, service);
       }
       break;
+    }
     case ARGP_KEY_END:
       return 0;
     default:
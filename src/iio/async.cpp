@@ -0,0 +1,137 @@
+#include <iio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <fsatutils/iio/async.hpp>
+#include <fsatutils/log/log.hpp>
+#include <thread>
+
+namespace fsatutils {
+
+namespace iio {
+
+class AsyncIO::Worker {
+ public:
+  Worker()
+      : thread_{[this](std::stop_token stoken) { this->workTask(stoken); }} {}
+
+  void push(std::function<void()> job) {
+    {
+      std::lock_guard<std::mutex> guard{mtx_};
+      jobs_.push_back(std::move(job));
+    }
+
+    cv_.notify_one();
+  }
+
+ private:
+  void workTask(std::stop_token stoken) {
+    while (true) {
+      std::function<void()> job;
+
+      {
+        std::unique_lock<std::mutex> lock{mtx_};
+
+        if (!cv_.wait(lock, stoken, [this] { return !jobs_.empty(); })) {
+          return;
+        }
+
+        job = std::move(jobs_.front());
+        jobs_.pop_front();
+      }
+
+      try {
+        job();
+      } catch (const std::exception& e) {
+        logs::log(ERR, "Asynchronous IIO job failed: %s\n", e.what());
+      }
+    }
+  }
+
+  std::mutex mtx_;
+  std::condition_variable_any cv_;
+  std::deque<std::function<void()>> jobs_;
+  std::jthread thread_;
+};
+
+AsyncIO::AsyncIO() = default;
+
+AsyncIO::~AsyncIO() = default;
+
+void AsyncIO::submit(Channel& ch, std::function<void()> job) {
+  const struct iio_context* ctx =
+      iio_device_get_context(iio_channel_get_device(ch));
+  Worker* worker;
+
+  {
+    std::lock_guard<std::mutex> guard{mtx_};
+    auto& w = workers_[ctx];
+
+    if (!w) w = std::make_unique<Worker>();
+
+    worker = w.get();
+  }
+
+  worker->push(std::move(job));
+}
+
+std::vector<AttrResult> AsyncIO::gather(std::vector<AttrRequest> requests,
+                                        std::chrono::milliseconds timeout) {
+  struct State {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<AttrResult> results;
+    std::vector<bool> done;
+    std::size_t pending;
+    bool expired = false;
+  };
+
+  auto state = std::make_shared<State>();
+
+  state->results.resize(requests.size());
+  state->done.resize(requests.size(), false);
+  state->pending = requests.size();
+
+  for (std::size_t i = 0; i < requests.size(); i++) {
+    auto& req = requests[i];
+
+    submit(req.channel, [state, i, ch = req.channel, attr = req.attr]() {
+      {
+        std::lock_guard<std::mutex> guard{state->mtx};
+        if (state->expired) return;
+      }
+
+      AttrResult res;
+
+      try {
+        res.value = ch.read_attr<std::string>(attr);
+      } catch (const std::exception& e) {
+        res.error = e.what();
+      }
+
+      std::lock_guard<std::mutex> guard{state->mtx};
+
+      if (state->expired) return;
+
+      state->results[i] = std::move(res);
+      state->done[i] = true;
+
+      if (--state->pending == 0U) state->cv.notify_one();
+    });
+  }
+
+  std::unique_lock<std::mutex> lock{state->mtx};
+
+  state->cv.wait_for(lock, timeout, [&state] { return state->pending == 0U; });
+  state->expired = true;
+
+  for (std::size_t i = 0; i < requests.size(); i++) {
+    if (!state->done[i]) state->results[i].error = "timeout";
+  }
+
+  return std::move(state->results);
+}
+
+}  // namespace iio
+
+}  // namespace fsatutils
@@ -0,0 +1,121 @@
+#include <iio.h>
+
+#include <fsatutils/errors.hpp>
+#include <fsatutils/iio/buffer.hpp>
+#include <fsatutils/iio/recording.hpp>
+#include <string>
+
+namespace fsatutils {
+
+namespace iio {
+
+Buffer::Buffer(Device& dev, std::size_t samples, bool cyclic)
+    : ctx_{dev.context()}, dev_{dev}, device_id_{iio_device_get_id(dev_)} {
+  replay_ = ctx_->replay();
+
+  if (replay_ != nullptr) {
+    auto idx = replay_->find_stream(device_id_);
+
+    if (!idx.has_value()) {
+      throw_runtime_error("No recorded blocks for " + device_id_ +
+                          " IIO Device!");
+    }
+
+    stream_ = idx.value();
+    step_ = replay_->stream(stream_).step;
+    layout_ = replay_->stream(stream_).layout;
+    return;
+  }
+
+  raw_ = iio_device_create_buffer(dev_, samples, cyclic);
+
+  if (raw_ == nullptr) {
+    throw_runtime_error("Failed to create " + device_id_ + " IIO Buffer!");
+  }
+
+  step_ = static_cast<std::size_t>(iio_buffer_step(raw_));
+
+  compute_layout();
+}
+
+Buffer::~Buffer() {
+  if (raw_ != nullptr) {
+    iio_buffer_destroy(raw_);
+    raw_ = nullptr;
+  }
+}
+
+std::size_t Buffer::refill() {
+  if (replay_ != nullptr) {
+    auto block = replay_->block(stream_, cursor_++);
+
+    if (!block.has_value()) {
+      data_ = {};
+      return 0;
+    }
+
+    data_ = block->data;
+    timestamp_ = block->timestamp_ns;
+
+    return data_.size();
+  }
+
+  if (iio_buffer_refill(raw_) < 0) {
+    throw_runtime_error("Failed to refill " + device_id_ + " IIO Buffer!");
+  }
+
+  timestamp_ = recording::now_ns();
+
+  auto start = static_cast<const std::uint8_t*>(iio_buffer_start(raw_));
+  auto end = static_cast<const std::uint8_t*>(iio_buffer_end(raw_));
+
+  data_ = {start, end};
+
+  return data_.size();
+}
+
+void Buffer::cancel() {
+  if (raw_ != nullptr) iio_buffer_cancel(raw_);
+}
+
+int Buffer::poll_fd() {
+  return (raw_ != nullptr) ? iio_buffer_get_poll_fd(raw_) : -1;
+}
+
+const ChannelLayout* Buffer::find(Channel const& ch) const {
+  std::string id = ch.id();
+
+  for (auto const& l : layout_) {
+    if (l.id == id) return &l;
+  }
+
+  return nullptr;
+}
+
+void Buffer::compute_layout() {
+  auto start = static_cast<const std::uint8_t*>(iio_buffer_start(raw_));
+  unsigned int count = iio_device_get_channels_count(dev_);
+
+  layout_.clear();
+
+  for (unsigned int i = 0; i < count; i++) {
+    struct iio_channel* ch = iio_device_get_channel(dev_, i);
+
+    if (!iio_channel_is_enabled(ch) || !iio_channel_is_scan_element(ch)) {
+      continue;
+    }
+
+    auto first = static_cast<const std::uint8_t*>(iio_buffer_first(raw_, ch));
+    const struct iio_data_format* fmt = iio_channel_get_data_format(ch);
+
+    layout_.push_back({
+        .id = iio_channel_get_id(ch),
+        .offset = static_cast<std::size_t>(first - start),
+        .length = (fmt->length / 8U) * std::max(fmt->repeat, 1U),
+    });
+  }
+}
+
+}  // namespace iio
+
+}  // namespace fsatutils
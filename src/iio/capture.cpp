@@ -0,0 +1,431 @@
+#include <iio.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fsatutils/errors.hpp>
+#include <fsatutils/iio/capture.hpp>
+#include <fsatutils/log/log.hpp>
+#include <limits>
+
+namespace fsatutils {
+
+namespace iio {
+
+namespace {
+
+constexpr double GAP_FACTOR = 1.5;
+constexpr double EMA_WEIGHT = 0.01;
+
+double decode(struct iio_channel* ch, const struct iio_data_format* fmt,
+              const std::uint8_t* src) {
+  std::uint8_t raw[8] = {};
+  double v = 0.0;
+
+  iio_channel_convert(ch, raw, src);
+
+  switch (fmt->length / 8U) {
+    case 1: {
+      std::uint8_t u;
+      std::memcpy(&u, raw, sizeof(u));
+      v = fmt->is_signed ? static_cast<std::int8_t>(u) : u;
+      break;
+    }
+    case 2: {
+      std::uint16_t u;
+      std::memcpy(&u, raw, sizeof(u));
+      v = fmt->is_signed ? static_cast<std::int16_t>(u) : u;
+      break;
+    }
+    case 4: {
+      std::uint32_t u;
+      std::memcpy(&u, raw, sizeof(u));
+      v = fmt->is_signed ? static_cast<std::int32_t>(u) : u;
+      break;
+    }
+    case 8: {
+      std::uint64_t u;
+      std::memcpy(&u, raw, sizeof(u));
+      v = fmt->is_signed ? static_cast<double>(static_cast<std::int64_t>(u))
+                         : static_cast<double>(u);
+      break;
+    }
+    default:
+      break;
+  }
+
+  return fmt->with_scale ? v * fmt->scale : v;
+}
+
+std::int64_t decode_ts(struct iio_channel* ch, const std::uint8_t* src) {
+  std::int64_t ts = 0;
+
+  iio_channel_convert(ch, &ts, src);
+
+  return ts;
+}
+
+}  // namespace
+
+CaptureGroup::CaptureGroup(std::chrono::nanoseconds frame_period,
+                           std::chrono::nanoseconds max_latency,
+                           std::size_t buffer_samples)
+    : frame_period_ns_{frame_period.count()},
+      max_latency_ns_{max_latency.count()},
+      buffer_samples_{buffer_samples} {
+  if (frame_period_ns_ <= 0) {
+    throw_runtime_error("Capture frame period must be positive!");
+  }
+}
+
+CaptureGroup::~CaptureGroup() { stop(); }
+
+void CaptureGroup::add(Device dev, std::vector<std::string> channels,
+                       std::string timestamp_channel) {
+  if (merge_thread_.joinable()) {
+    throw_runtime_error("Cannot add devices to a running capture group!");
+  }
+
+  if (sources_.size() == 64U) {
+    throw_runtime_error("Capture groups are limited to 64 devices!");
+  }
+
+  auto src = std::make_unique<Source>(std::move(dev));
+
+  for (auto const& name : channels) {
+    auto ch = src->device.find_device_channel(name, false);
+    ch.enable();
+    src->channels.push_back(ch);
+  }
+
+  src->ts_channel = src->device.find_device_channel(timestamp_channel, false);
+  src->ts_channel->enable();
+  src->prev.resize(src->channels.size());
+
+  sources_.push_back(std::move(src));
+}
+
+void CaptureGroup::start(FrameCallback cb) {
+  if (merge_thread_.joinable() || sources_.empty()) return;
+
+  std::size_t width = 0;
+
+  for (auto& src : sources_) {
+    src->buffer = std::make_unique<Buffer>(src->device, buffer_samples_);
+    src->head = src->tail = 0;
+    src->finished = false;
+    src->pos = 0;
+    src->has_prev = false;
+    src->fill_last_ts = 0;
+
+    for (auto& chunk : src->ring) {
+      chunk.ts.resize(buffer_samples_);
+      chunk.values.resize(buffer_samples_ * src->channels.size());
+      chunk.count = 0;
+    }
+
+    width += src->channels.size();
+  }
+
+  frame_values_.assign(width, 0.0);
+  cb_ = std::move(cb);
+
+  for (auto& src : sources_) {
+    refill_threads_.emplace_back([this, s = src.get()](std::stop_token st) {
+      this->refillTask(st, *s);
+    });
+  }
+
+  merge_thread_ =
+      std::jthread{[this](std::stop_token stoken) { this->mergeTask(stoken); }};
+}
+
+void CaptureGroup::stop() {
+  for (auto& t : refill_threads_) t.request_stop();
+
+  for (auto& src : sources_) {
+    if (src->buffer) src->buffer->cancel();
+  }
+
+  merge_thread_.request_stop();
+  published_.fetch_add(1U, std::memory_order_release);
+  published_.notify_all();
+
+  refill_threads_.clear();
+
+  if (merge_thread_.joinable()) merge_thread_.join();
+
+  merge_thread_ = {};
+
+  for (auto& src : sources_) src->buffer.reset();
+}
+
+CaptureGroup::Stats CaptureGroup::stats() const {
+  Stats s{
+      .frames = frames_.load(std::memory_order_relaxed),
+      .gap_frames = gap_frames_.load(std::memory_order_relaxed),
+      .sources = {},
+  };
+
+  for (auto const& src : sources_) {
+    s.sources.push_back({
+        .device = src->device.name(),
+        .blocks = src->blocks.load(std::memory_order_relaxed),
+        .samples = src->samples.load(std::memory_order_relaxed),
+        .overruns = src->overruns.load(std::memory_order_relaxed),
+        .gaps = src->gaps.load(std::memory_order_relaxed),
+        .gap_ns = src->gap_ns.load(std::memory_order_relaxed),
+        .period_ns = src->period_ns.load(std::memory_order_relaxed),
+        .drift_ns = src->drift_ns.load(std::memory_order_relaxed),
+    });
+  }
+
+  return s;
+}
+
+void CaptureGroup::refillTask(std::stop_token stoken, Source& src) {
+  std::vector<const struct iio_data_format*> formats;
+
+  for (auto& ch : src.channels) {
+    formats.push_back(iio_channel_get_data_format(ch));
+  }
+
+  while (!stoken.stop_requested()) {
+    std::size_t bytes = 0;
+
+    try {
+      bytes = src.buffer->refill();
+    } catch (const std::exception& e) {
+      if (!stoken.stop_requested()) {
+        logs::log(ERR, "Capture of %s stopped: %s\n",
+                  src.device.name().c_str(), e.what());
+      }
+      break;
+    }
+
+    if (bytes == 0) break;
+
+    src.blocks.fetch_add(1U, std::memory_order_relaxed);
+
+    std::size_t head = src.head.load(std::memory_order_relaxed);
+
+    if (head - src.tail.load(std::memory_order_acquire) == RING_SIZE) {
+      src.overruns.fetch_add(1U, std::memory_order_relaxed);
+      continue;
+    }
+
+    Chunk& chunk = src.ring[head % RING_SIZE];
+    Buffer const& buf = *src.buffer;
+    std::size_t count = buf.samples();
+    std::size_t nchan = src.channels.size();
+    const ChannelLayout* ts_layout = buf.find(*src.ts_channel);
+
+    if (ts_layout == nullptr) {
+      logs::log(ERR, "Capture of %s has no timestamp channel in buffer\n",
+                src.device.name().c_str());
+      break;
+    }
+
+    if (chunk.ts.size() < count) {
+      chunk.ts.resize(count);
+      chunk.values.resize(count * nchan);
+    }
+
+    const std::uint8_t* base = buf.data().data();
+
+    for (std::size_t i = 0; i < count; i++) {
+      chunk.ts[i] = decode_ts(*src.ts_channel,
+                              base + i * buf.step() + ts_layout->offset);
+    }
+
+    for (std::size_t j = 0; j < nchan; j++) {
+      const ChannelLayout* l = buf.find(src.channels[j]);
+
+      for (std::size_t i = 0; i < count; i++) {
+        chunk.values[i * nchan + j] =
+            (l != nullptr)
+                ? decode(src.channels[j], formats[j],
+                         base + i * buf.step() + l->offset)
+                : std::numeric_limits<double>::quiet_NaN();
+      }
+    }
+
+    chunk.count = count;
+
+    /* Period estimation and gap detection on the device timestamps */
+    double period = src.period_ns.load(std::memory_order_relaxed);
+
+    for (std::size_t i = 0; i < count; i++) {
+      if (src.fill_last_ts != 0) {
+        double delta = static_cast<double>(chunk.ts[i] - src.fill_last_ts);
+
+        if (period > 0.0 && delta > GAP_FACTOR * period) {
+          src.gaps.fetch_add(1U, std::memory_order_relaxed);
+          src.gap_ns.fetch_add(static_cast<std::uint64_t>(delta - period),
+                               std::memory_order_relaxed);
+        } else if (delta > 0.0) {
+          period = (period == 0.0)
+                       ? delta
+                       : (1.0 - EMA_WEIGHT) * period + EMA_WEIGHT * delta;
+        }
+      }
+
+      src.fill_last_ts = chunk.ts[i];
+    }
+
+    src.period_ns.store(period, std::memory_order_relaxed);
+    src.samples.fetch_add(count, std::memory_order_relaxed);
+
+    if (count > 0) {
+      src.newest_ts.store(chunk.ts[count - 1U], std::memory_order_relaxed);
+    }
+
+    src.head.store(head + 1U, std::memory_order_release);
+    published_.fetch_add(1U, std::memory_order_release);
+    published_.notify_one();
+  }
+
+  src.finished.store(true, std::memory_order_release);
+  published_.fetch_add(1U, std::memory_order_release);
+  published_.notify_one();
+}
+
+bool CaptureGroup::sample(Source& src, std::int64_t t, double* out) {
+  std::size_t nchan = src.channels.size();
+
+  while (true) {
+    std::size_t tail = src.tail.load(std::memory_order_relaxed);
+
+    if (tail == src.head.load(std::memory_order_acquire)) break;
+
+    Chunk& chunk = src.ring[tail % RING_SIZE];
+
+    while (src.pos < chunk.count && chunk.ts[src.pos] < t) {
+      src.prev_ts = chunk.ts[src.pos];
+      std::copy_n(&chunk.values[src.pos * nchan], nchan, src.prev.begin());
+      src.has_prev = true;
+      src.pos++;
+    }
+
+    if (src.pos < chunk.count) {
+      const double* next = &chunk.values[src.pos * nchan];
+      std::int64_t next_ts = chunk.ts[src.pos];
+
+      if (!src.has_prev || next_ts == t) {
+        std::copy_n(next, nchan, out);
+        return true;
+      }
+
+      double w = static_cast<double>(t - src.prev_ts) /
+                 static_cast<double>(next_ts - src.prev_ts);
+
+      for (std::size_t j = 0; j < nchan; j++) {
+        out[j] = src.prev[j] + w * (next[j] - src.prev[j]);
+      }
+
+      return true;
+    }
+
+    src.pos = 0;
+    src.tail.store(tail + 1U, std::memory_order_release);
+  }
+
+  /* No sample at or after t yet: hold the last value and flag a gap */
+  if (src.has_prev) {
+    std::copy_n(src.prev.begin(), nchan, out);
+  } else {
+    std::fill_n(out, nchan, std::numeric_limits<double>::quiet_NaN());
+  }
+
+  return false;
+}
+
+void CaptureGroup::mergeTask(std::stop_token stoken) {
+  constexpr std::int64_t UNSET = std::numeric_limits<std::int64_t>::min();
+  std::int64_t t = UNSET;
+
+  while (!stoken.stop_requested()) {
+    std::uint64_t seen = published_.load(std::memory_order_acquire);
+    bool all_finished = true;
+    bool ready = true;
+    std::int64_t newest = UNSET;
+
+    for (auto& src : sources_) {
+      bool finished = src->finished.load(std::memory_order_acquire);
+      bool has_data = src->samples.load(std::memory_order_relaxed) != 0U;
+      std::int64_t ts = src->newest_ts.load(std::memory_order_relaxed);
+
+      all_finished = all_finished && finished;
+
+      if (has_data) newest = std::max(newest, ts);
+
+      if (!finished && (!has_data || (t != UNSET && ts < t))) ready = false;
+    }
+
+    if (t == UNSET && newest != UNSET && ready) {
+      /* Start on the first grid point covered by every device */
+      std::int64_t first = UNSET;
+
+      for (auto& src : sources_) {
+        std::size_t tail = src->tail.load(std::memory_order_relaxed);
+
+        if (tail != src->head.load(std::memory_order_acquire)) {
+          first = std::max(first, src->ring[tail % RING_SIZE].ts[0]);
+        }
+      }
+
+      if (first != UNSET) {
+        t = ((first + frame_period_ns_ - 1) / frame_period_ns_) *
+            frame_period_ns_;
+      }
+    }
+
+    bool stalled = t != UNSET && newest != UNSET && newest >= t &&
+                   newest - t >= max_latency_ns_;
+
+    if (t != UNSET && (ready || stalled) && newest >= t) {
+      std::uint64_t gap_mask = 0;
+      std::size_t offset = 0;
+      std::int64_t ref = sources_.front()->newest_ts.load();
+
+      for (std::size_t i = 0; i < sources_.size(); i++) {
+        Source& src = *sources_[i];
+
+        if (!sample(src, t, frame_values_.data() + offset)) {
+          gap_mask |= 1ULL << i;
+        }
+
+        double drift = static_cast<double>(src.newest_ts.load() - ref);
+        double prev = src.drift_ns.load(std::memory_order_relaxed);
+
+        src.drift_ns.store((1.0 - EMA_WEIGHT) * prev + EMA_WEIGHT * drift,
+                           std::memory_order_relaxed);
+
+        offset += src.channels.size();
+      }
+
+      frames_.fetch_add(1U, std::memory_order_relaxed);
+
+      if (gap_mask != 0U) gap_frames_.fetch_add(1U, std::memory_order_relaxed);
+
+      if (cb_) {
+        cb_(Frame{
+            .timestamp_ns = static_cast<std::uint64_t>(t),
+            .values = frame_values_,
+            .gap_mask = gap_mask,
+        });
+      }
+
+      t += frame_period_ns_;
+      continue;
+    }
+
+    if (all_finished) break;
+
+    published_.wait(seen, std::memory_order_acquire);
+  }
+}
+
+}  // namespace iio
+
+}  // namespace fsatutils
@@ -4,6 +4,7 @@
 #include <string>
 #include <fsatutils/errors.hpp>
 #include <fsatutils/iio/channel.hpp>
+#include <fsatutils/iio/recording.hpp>
 #include <fsatutils/log/log.hpp>
 
 namespace fsatutils {
@@ -11,8 +12,11 @@ namespace fsatutils {
 namespace iio {
 
 Channel::Channel(std::string name, struct iio_device* device,
-                 bool output_channel)
-    : dev_{device}, name_{std::move(name)}, output_{output_channel} {
+                 bool output_channel, Replay* replay)
+    : dev_{device},
+      name_{std::move(name)},
+      output_{output_channel},
+      replay_{replay} {
   raw_ = iio_device_find_channel(dev_, name_.c_str(), output_);
 
   if (raw_ == nullptr) {
@@ -22,6 +26,8 @@ Channel::Channel(std::string name, struct iio_device* device,
 
 template <>
 void Channel::write_attr(std::string const& attr, long long const& value) {
+  if (replay_write(attr, std::to_string(value))) return;
+
   int res = iio_channel_attr_write_longlong(raw_, attr.c_str(), value);
   if (res < 0) {
     throw_runtime_error("Failed to write " + attr + " Channel attribute!");
@@ -30,6 +36,8 @@ void Channel::write_attr(std::string const& attr, long long const& value) {
 
 template <>
 void Channel::write_attr(std::string const& attr, bool const& value) {
+  if (replay_write(attr, value ? "1" : "0")) return;
+
   int res = iio_channel_attr_write_bool(raw_, attr.c_str(), value);
   if (res < 0) {
     throw_runtime_error("Failed to write " + attr + " Channel attribute!");
@@ -38,6 +46,8 @@ void Channel::write_attr(std::string const& attr, bool const& value) {
 
 template <>
 void Channel::write_attr(std::string const& attr, std::string const& value) {
+  if (replay_write(attr, value)) return;
+
   int res = iio_channel_attr_write(raw_, attr.c_str(), value.c_str());
 
   if ((res < 0) || (res != static_cast<int>(value.length() + 1))) {
@@ -49,6 +59,8 @@ template <>
 long long Channel::read_attr(std::string const& attr) const {
   long long val = 0;
 
+  if (auto replayed = replayed_attr(attr)) return std::stoll(*replayed);
+
   int res = iio_channel_attr_read_longlong(raw_, attr.c_str(), &val);
 
   if (res < 0) {
@@ -62,6 +74,8 @@ template <>
 std::string Channel::read_attr(std::string const& attr) const {
   std::array<char, 1024U> buf;
 
+  if (auto replayed = replayed_attr(attr)) return *replayed;
+
   int res = iio_channel_attr_read(raw_, attr.c_str(), buf.data(), buf.size());
 
   if (res < 0) {
@@ -75,6 +89,8 @@ template <>
 bool Channel::read_attr(std::string const& attr) const {
   bool val;
 
+  if (auto replayed = replayed_attr(attr)) return std::stoll(*replayed) != 0;
+
   int res = iio_channel_attr_read_bool(raw_, attr.c_str(), &val);
 
   if (res < 0) {
@@ -88,6 +104,8 @@ template <>
 double Channel::read_attr(std::string const& attr) const {
   double val;
 
+  if (auto replayed = replayed_attr(attr)) return std::stod(*replayed);
+
   int res = iio_channel_attr_read_double(raw_, attr.c_str(), &val);
 
   if (res < 0) {
@@ -97,6 +115,27 @@ double Channel::read_attr(std::string const& attr) const {
   return val;
 }
 
+std::optional<std::string> Channel::replayed_attr(
+    std::string const& attr) const {
+  if (replay_ == nullptr) return std::nullopt;
+
+  auto val = replay_->attr(iio_device_get_id(dev_), id(), output_, attr);
+
+  if (!val.has_value()) {
+    throw_runtime_error("Failed to read " + attr + " Channel attribute!");
+  }
+
+  return val;
+}
+
+bool Channel::replay_write(std::string const& attr, std::string const& value) {
+  if (replay_ == nullptr) return false;
+
+  replay_->write_attr(iio_device_get_id(dev_), id(), output_, attr, value);
+
+  return true;
+}
+
 }  // namespace iio
 
 }  // namespace fsatutils
@@ -1,57 +1,58 @@
 #include <iio.h>
 
+#include <filesystem>
+#include <fstream>
+#include <iterator>
 #include <string>
 #include <fsatutils/errors.hpp>
 #include <fsatutils/iio/context.hpp>
+#include <fsatutils/iio/recording.hpp>
+#include <fsatutils/log/log.hpp>
 
 namespace fsatutils {
 
 namespace iio {
 
-Context::Context(ContextType type) {
-  switch (type) {
-    case ContextType::NETWORK:
-      raw_ = iio_create_network_context("127.0.0.1");
-      type_ = ContextType::NETWORK;
-      break;
-    case ContextType::LOCAL:
-      raw_ = iio_create_local_context();
-      type_ = ContextType::LOCAL;
-      break;
-    case ContextType::USB: /* Not implemented yet */
-    case ContextType::XML: /* Not implemented yet */
-    case ContextType::DEFAULT:
-      raw_ = iio_create_default_context();
-      type_ = ContextType::DEFAULT;
-      break;
+Context::Context(ContextType type) : type_{type} {
+  raw_ = create(type, "");
+
+  if (raw_ == nullptr) {
+    throw_runtime_error("Failed to create IIO Context!");
   }
+}
+
+Context::Context(ContextType type, std::string& uri) : type_{type}, uri_{uri} {
+  raw_ = create(type, uri);
 
   if (raw_ == nullptr) {
     throw_runtime_error("Failed to create IIO Context!");
   }
 }
 
-Context::Context(ContextType type, std::string& uri) {
-  switch (type) {
-    case ContextType::NETWORK:
-      raw_ = iio_create_network_context(uri.c_str());
-      type_ = ContextType::NETWORK;
-      break;
-    case ContextType::LOCAL:
-      raw_ = iio_create_local_context();
-      type_ = ContextType::LOCAL;
-      break;
-    case ContextType::USB: /* Not implemented yet */
-    case ContextType::XML: /* Not implemented yet */
-    case ContextType::DEFAULT:
-      raw_ = iio_create_default_context();
-      type_ = ContextType::DEFAULT;
-      break;
+Context::Context(ContextType type, std::string const& uri,
+                 std::string cache_path)
+    : type_{type}, uri_{uri}, cache_path_{std::move(cache_path)} {
+  if (std::filesystem::exists(cache_path_)) {
+    cached_ = iio_create_xml_context(cache_path_.c_str());
+
+    if (cached_ == nullptr) {
+      logs::log(WARN, "Ignoring unreadable IIO context cache [%s]\n",
+                cache_path_.c_str());
+    }
   }
 
+  if (cached_ != nullptr) return;
+
+  raw_ = create(type, uri);
+
   if (raw_ == nullptr) {
     throw_runtime_error("Failed to create IIO Context!");
   }
+
+  if (!save_description(cache_path_)) {
+    logs::log(WARN, "Failed to cache IIO context description in [%s]\n",
+              cache_path_.c_str());
+  }
 }
 
 Context::~Context() {
@@ -59,6 +60,126 @@ Context::~Context() {
     iio_context_destroy(raw_);
     raw_ = nullptr;
   }
+
+  if (cached_ != nullptr) {
+    iio_context_destroy(cached_);
+    cached_ = nullptr;
+  }
+}
+
+struct iio_context* Context::create(ContextType type, std::string const& uri) {
+  switch (type) {
+    case ContextType::NETWORK:
+      return iio_create_network_context(uri.empty() ? "127.0.0.1"
+                                                    : uri.c_str());
+    case ContextType::LOCAL:
+      return iio_create_local_context();
+    case ContextType::USB: {
+      std::string usb_uri = uri.starts_with("usb:") ? uri : "usb:" + uri;
+      return iio_create_context_from_uri(usb_uri.c_str());
+    }
+    case ContextType::XML:
+      if (uri.empty()) {
+        throw_runtime_error("XML IIO Context requires a description file!");
+      }
+      return iio_create_xml_context(uri.c_str());
+    case ContextType::DEFAULT:
+      return iio_create_default_context();
+    case ContextType::REPLAY: {
+      if (uri.empty()) {
+        throw_runtime_error("Replay IIO Context requires a recording file!");
+      }
+      replay_ = std::make_shared<Replay>(uri);
+      auto xml = replay_->description();
+      return iio_create_xml_context_mem(xml.data(), xml.size());
+    }
+  }
+
+  return nullptr;
+}
+
+struct iio_context* Context::live() {
+  if (raw_ == nullptr && !revalidate()) {
+    throw_runtime_error("Failed to connect to live IIO Context!");
+  }
+
+  return raw_;
+}
+
+std::vector<std::string> Context::device_names() {
+  struct iio_context* ctx = description();
+  std::vector<std::string> names;
+
+  unsigned int count = iio_context_get_devices_count(ctx);
+
+  names.reserve(count);
+
+  for (unsigned int i = 0; i < count; i++) {
+    struct iio_device* dev = iio_context_get_device(ctx, i);
+    const char* name = iio_device_get_name(dev);
+
+    names.emplace_back((name != nullptr) ? name : iio_device_get_id(dev));
+  }
+
+  return names;
+}
+
+bool Context::save_description(std::string const& path) {
+  struct iio_context* ctx = description();
+  const char* xml = iio_context_get_xml(ctx);
+
+  if (xml == nullptr) return false;
+
+  std::filesystem::path target{path};
+  std::filesystem::path tmp{path + ".tmp"};
+
+  if (target.has_parent_path()) {
+    std::error_code ec;
+    std::filesystem::create_directories(target.parent_path(), ec);
+  }
+
+  std::ofstream ofs{tmp, std::ios::out | std::ios::trunc};
+  ofs << xml;
+  ofs.close();
+
+  if (!ofs) return false;
+
+  std::error_code ec;
+  std::filesystem::rename(tmp, target, ec);
+
+  return !ec;
+}
+
+bool Context::revalidate() {
+  if (raw_ == nullptr) {
+    raw_ = create(type_, uri_);
+
+    if (raw_ == nullptr) return false;
+  }
+
+  if (cache_path_.empty()) return true;
+
+  std::ifstream ifs{cache_path_};
+  std::string cached_xml{std::istreambuf_iterator<char>{ifs},
+                         std::istreambuf_iterator<char>{}};
+  const char* live_xml = iio_context_get_xml(raw_);
+
+  if (live_xml != nullptr && cached_xml != live_xml) {
+    logs::log(WARN, "IIO context cache [%s] is stale, refreshing...\n",
+              cache_path_.c_str());
+
+    if (!save_description(cache_path_)) {
+      logs::log(WARN, "Failed to refresh IIO context cache [%s]\n",
+                cache_path_.c_str());
+    }
+  }
+
+  if (cached_ != nullptr) {
+    iio_context_destroy(cached_);
+    cached_ = nullptr;
+  }
+
+  return true;
 }
 
 }  // namespace iio
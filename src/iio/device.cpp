@@ -4,6 +4,7 @@
 #include <string>
 #include <fsatutils/errors.hpp>
 #include <fsatutils/iio/device.hpp>
+#include <fsatutils/iio/event.hpp>
 
 namespace fsatutils {
 
@@ -11,24 +12,39 @@ namespace iio {
 
 Device::Device(std::shared_ptr<Context> ctx, std::string name)
     : ctx_{ctx}, name_{std::move(name)} {
-  raw_ = iio_context_find_device(*ctx_, name_.c_str());
+  /* Checked against the cached description so a cached context stays offline
+   * until the device is actually used */
+  if (iio_context_find_device(ctx_->description(), name_.c_str()) == nullptr) {
+    throw_runtime_error("Failed to create " + name_ + " IIO Device!");
+  }
+}
 
+struct iio_device* Device::resolve() {
   if (raw_ == nullptr) {
-    throw_runtime_error("Failed to create " + name_ + " IIO Device!");
+    raw_ = iio_context_find_device(*ctx_, name_.c_str());
+
+    if (raw_ == nullptr) {
+      throw_runtime_error("Failed to find " + name_ + " in live IIO Context!");
+    }
   }
+
+  return raw_;
 }
 
 Channel Device::find_device_channel(std::string const& channel_name,
                                     bool output) {
-  auto ch = iio_device_find_channel(raw_, channel_name.c_str(), output);
+  struct iio_device* dev = resolve();
+  auto ch = iio_device_find_channel(dev, channel_name.c_str(), output);
 
   if (ch == nullptr) {
     throw_runtime_error("Failed to find " + channel_name + " IIO Channel!");
   }
 
-  return {channel_name, raw_, output};
+  return {channel_name, dev, output, ctx_->replay()};
 }
 
+EventStream Device::open_events() { return EventStream{*this}; }
+
 }  // namespace iio
 
 }  // namespace fsatutils
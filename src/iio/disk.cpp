@@ -0,0 +1,587 @@
+#include <fcntl.h>
+#include <iio.h>
+#include <unistd.h>
+#ifdef FSATUTILS_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fsatutils/errors.hpp>
+#include <fsatutils/iio/disk.hpp>
+#include <fsatutils/log/log.hpp>
+
+namespace fsatutils {
+
+namespace iio {
+
+namespace {
+
+/* O_DIRECT wants buffers, offsets and sizes aligned to the logical block
+ * size; a page covers every device we record to. */
+constexpr std::size_t PAGE = 4096U;
+
+constexpr std::size_t page_align(std::size_t n) {
+  return (n + PAGE - 1U) & ~(PAGE - 1U);
+}
+
+std::uint8_t* alloc_aligned(std::size_t size) {
+  return static_cast<std::uint8_t*>(std::aligned_alloc(PAGE, size));
+}
+
+bool pwrite_all(int fd, const std::uint8_t* data, std::size_t size,
+                std::uint64_t offset) {
+  while (size > 0) {
+    ssize_t res = pwrite(fd, data, size, static_cast<off_t>(offset));
+
+    if (res < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+
+    data += res;
+    size -= static_cast<std::size_t>(res);
+    offset += static_cast<std::uint64_t>(res);
+  }
+
+  return true;
+}
+
+void write_record(std::uint8_t* p, recording::RecordType type,
+                  std::uint16_t stream, std::uint64_t ts, std::size_t payload,
+                  std::size_t total,
+                  std::initializer_list<std::span<const std::uint8_t>> parts) {
+  recording::RecordHeader rh{
+      .type = type,
+      .reserved = 0,
+      .stream = stream,
+      .size = static_cast<std::uint32_t>(payload),
+      .timestamp_ns = ts,
+  };
+
+  std::memcpy(p, &rh, sizeof(rh));
+
+  std::uint8_t* dst = p + sizeof(rh);
+
+  for (auto const& part : parts) {
+    std::memcpy(dst, part.data(), part.size());
+    dst += part.size();
+  }
+
+  std::memset(dst, 0, static_cast<std::size_t>(p + total - dst));
+}
+
+void write_pad(std::uint8_t* p, std::size_t size) {
+  recording::RecordHeader rh{
+      .type = recording::RecordType::PAD,
+      .reserved = 0,
+      .stream = 0,
+      .size = static_cast<std::uint32_t>(size - sizeof(rh)),
+      .timestamp_ns = 0,
+  };
+
+  std::memcpy(p, &rh, sizeof(rh));
+}
+
+}  // namespace
+
+struct DiskRecorder::Uring {
+#ifdef FSATUTILS_HAVE_LIBURING
+  struct io_uring ring;
+#endif
+};
+
+DiskRecorder::DiskRecorder(std::shared_ptr<Context> ctx, std::string path,
+                           Options opts)
+    : ctx_{std::move(ctx)},
+      path_{std::move(path)},
+      opts_{opts},
+      start_ns_{recording::now_ns()},
+      started_{std::chrono::steady_clock::now()} {
+  if (opts_.buffers == 0U || opts_.buffer_size == 0U ||
+      opts_.buffer_size % PAGE != 0U) {
+    throw_runtime_error("Recording buffers must be page-sized multiples!");
+  }
+
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+  if (opts_.direct) {
+    fd_ = ::open(path_.c_str(), flags | O_DIRECT, 0644);
+
+    /* tmpfs and some network filesystems refuse O_DIRECT */
+    if (fd_ < 0 && errno == EINVAL) {
+      logs::log(WARN, "O_DIRECT not supported for %s, using buffered I/O\n",
+                path_.c_str());
+    }
+  }
+
+  if (fd_ < 0) fd_ = ::open(path_.c_str(), flags, 0644);
+
+  if (fd_ < 0) {
+    throw_runtime_error("Failed to open IIO recording " + path_ + "!");
+  }
+
+  std::string_view xml{iio_context_get_xml(*ctx_)};
+
+  header_size_ = page_align(sizeof(recording::FileHeader) + xml.size());
+  header_ = alloc_aligned(header_size_);
+
+  if (header_ == nullptr) {
+    ::close(fd_);
+    throw_runtime_error("Failed to allocate IIO recording header!");
+  }
+
+  recording::FileHeader hdr{};
+
+  std::memcpy(hdr.magic, recording::MAGIC, sizeof(hdr.magic));
+  hdr.version = recording::VERSION;
+  hdr.description_offset = sizeof(recording::FileHeader);
+  hdr.description_size = xml.size();
+  hdr.data_offset = header_size_;
+  hdr.start_ns = start_ns_;
+
+  std::memset(header_, 0, header_size_);
+  std::memcpy(header_, &hdr, sizeof(hdr));
+  std::memcpy(header_ + sizeof(hdr), xml.data(), xml.size());
+
+  if (!pwrite_all(fd_, header_, header_size_, 0)) {
+    std::free(header_);
+    ::close(fd_);
+    throw_runtime_error("Failed to write IIO recording " + path_ + "!");
+  }
+
+  next_offset_ = data_end_ = header_size_;
+
+  for (std::size_t i = 0; i < opts_.buffers; i++) {
+    std::uint8_t* slot = alloc_aligned(opts_.buffer_size);
+
+    if (slot == nullptr) break;
+
+    slots_.push_back(slot);
+    free_.push_back(i);
+  }
+
+  if (slots_.empty()) {
+    std::free(header_);
+    ::close(fd_);
+    throw_runtime_error("Failed to allocate IIO recording buffers!");
+  }
+
+  grow(opts_.preallocate);
+
+#ifdef FSATUTILS_HAVE_LIBURING
+  uring_ = std::make_unique<Uring>();
+
+  if (io_uring_queue_init(static_cast<unsigned>(slots_.size() + 1U),
+                          &uring_->ring, 0) < 0) {
+    logs::log(WARN, "io_uring unavailable, recording with pwrite\n");
+    uring_.reset();
+  }
+#endif
+
+  thread_ =
+      std::jthread{[this](std::stop_token stoken) { this->workTask(stoken); }};
+}
+
+DiskRecorder::~DiskRecorder() {
+  try {
+    close();
+  } catch (const std::exception& e) {
+    logs::log(ERR, "Failed to finalize IIO recording: %s\n", e.what());
+  }
+
+  for (auto* slot : slots_) std::free(slot);
+
+  std::free(header_);
+}
+
+bool DiskRecorder::record(Buffer const& buf) {
+  std::lock_guard<std::mutex> guard{mtx_};
+
+  if (closed_) return false;
+
+  auto stream = stream_for(buf);
+  bool ok = stream.has_value() &&
+            append(recording::RecordType::BLOCK, *stream, buf.timestamp(),
+                   {buf.data()});
+
+  if (ok) {
+    records_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  return ok;
+}
+
+void DiskRecorder::close() {
+  {
+    std::lock_guard<std::mutex> guard{mtx_};
+
+    if (closed_) return;
+
+    closed_ = true;
+
+    if (current_ != NO_SLOT) submit_current(true);
+  }
+
+  /* The writer drains the queue before it honours the stop request */
+  thread_.request_stop();
+  if (thread_.joinable()) thread_.join();
+
+#ifdef FSATUTILS_HAVE_LIBURING
+  if (uring_) io_uring_queue_exit(&uring_->ring);
+#endif
+
+  std::size_t index_size = index_.size() * sizeof(recording::IndexEntry);
+  std::uint8_t* index = alloc_aligned(page_align(index_size) + PAGE);
+  bool indexed = false;
+
+  if (index != nullptr) {
+    std::memset(index, 0, page_align(index_size) + PAGE);
+    std::memcpy(index, index_.data(), index_size);
+
+    indexed = pwrite_all(fd_, index, page_align(index_size), data_end_);
+    std::free(index);
+  }
+
+  if (!indexed) {
+    logs::log(ERR, "Failed to write IIO recording index, readers will scan\n");
+  }
+
+  recording::FileHeader hdr;
+  std::memcpy(&hdr, header_, sizeof(hdr));
+
+  hdr.index_offset = indexed ? data_end_ : 0U;
+  hdr.index_count = indexed ? index_.size() : 0U;
+  hdr.stream_count = static_cast<std::uint32_t>(streams_.size());
+
+  std::memcpy(header_, &hdr, sizeof(hdr));
+
+  if (!pwrite_all(fd_, header_, header_size_, 0)) {
+    logs::log(ERR, "Failed to update IIO recording header %s\n",
+              path_.c_str());
+  }
+
+  std::uint64_t size = data_end_ + (indexed ? index_size : 0U);
+
+  if (ftruncate(fd_, static_cast<off_t>(size)) < 0) {
+    logs::log(ERR, "Failed to truncate IIO recording %s\n", path_.c_str());
+  }
+
+  fdatasync(fd_);
+  ::close(fd_);
+  fd_ = -1;
+}
+
+DiskRecorder::Stats DiskRecorder::stats() const {
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - started_;
+  std::uint64_t bytes = bytes_written_.load(std::memory_order_relaxed);
+
+  return {
+      .records = records_.load(std::memory_order_relaxed),
+      .bytes_written = bytes,
+      .dropped = dropped_.load(std::memory_order_relaxed),
+      .write_errors = write_errors_.load(std::memory_order_relaxed),
+      .peak_queue = peak_queue_.load(std::memory_order_relaxed),
+      .throughput_bps =
+          elapsed.count() > 0.0 ? static_cast<double>(bytes) / elapsed.count()
+                                : 0.0,
+  };
+}
+
+std::optional<std::uint16_t> DiskRecorder::stream_for(Buffer const& buf) {
+  /* A Buffer's layout is fixed for its lifetime, so the common case of the
+   * same buffer being recorded over and over skips the layout encoding */
+  if (last_buf_ == &buf && last_step_ == buf.step() &&
+      last_device_ == buf.device_id()) {
+    return last_stream_;
+  }
+
+  auto layout = recording::encode_layout(buf.device_id(), buf.step(),
+                                         buf.layout());
+  auto it = std::find(streams_.begin(), streams_.end(), layout);
+  auto stream = static_cast<std::uint16_t>(it - streams_.begin());
+
+  if (it == streams_.end()) {
+    if (!append(recording::RecordType::LAYOUT, stream, recording::now_ns(),
+                {layout})) {
+      return std::nullopt;
+    }
+
+    streams_.push_back(std::move(layout));
+  }
+
+  last_buf_ = &buf;
+  last_device_ = buf.device_id();
+  last_step_ = buf.step();
+  last_stream_ = stream;
+
+  return stream;
+}
+
+bool DiskRecorder::append(
+    recording::RecordType type, std::uint16_t stream, std::uint64_t ts,
+    std::initializer_list<std::span<const std::uint8_t>> parts) {
+  constexpr std::size_t HDR = sizeof(recording::RecordHeader);
+  std::size_t payload = 0;
+
+  for (auto const& part : parts) payload += part.size();
+
+  std::size_t total = recording::align(HDR + payload);
+
+  if (total + HDR > opts_.buffer_size) {
+    return append_oversized(type, stream, ts, parts);
+  }
+
+  /* Every buffer tail must be either empty or large enough for a PAD
+   * record, so a record is only placed if it keeps that true */
+  auto fits = [&] {
+    std::size_t remaining = opts_.buffer_size - fill_;
+    return total == remaining || total + HDR <= remaining;
+  };
+
+  if (current_ == NO_SLOT || !fits()) {
+    if (current_ != NO_SLOT) submit_current(false);
+    if (!acquire()) return false;
+  }
+
+  write_record(slots_[current_] + fill_, type, stream, ts, payload, total,
+               parts);
+
+  index_.push_back({
+      .offset = current_offset_ + fill_,
+      .timestamp_ns = ts,
+      .type = type,
+      .reserved = 0,
+      .stream = stream,
+      .size = static_cast<std::uint32_t>(payload),
+  });
+
+  fill_ += total;
+
+  if (fill_ == opts_.buffer_size) submit_current(false);
+
+  return true;
+}
+
+bool DiskRecorder::append_oversized(
+    recording::RecordType type, std::uint16_t stream, std::uint64_t ts,
+    std::initializer_list<std::span<const std::uint8_t>> parts) {
+  constexpr std::size_t HDR = sizeof(recording::RecordHeader);
+  std::size_t payload = 0;
+
+  for (auto const& part : parts) payload += part.size();
+
+  std::size_t total = recording::align(HDR + payload);
+  std::size_t size = page_align(total + HDR);
+  std::uint8_t* p = alloc_aligned(size);
+
+  if (p == nullptr) return false;
+
+  write_record(p, type, stream, ts, payload, total, parts);
+  write_pad(p + total, size - total);
+
+  std::uint64_t offset = next_offset_;
+  next_offset_ += size;
+
+  index_.push_back({
+      .offset = offset,
+      .timestamp_ns = ts,
+      .type = type,
+      .reserved = 0,
+      .stream = stream,
+      .size = static_cast<std::uint32_t>(payload),
+  });
+
+  push({.data = p, .size = size, .offset = offset, .slot = NO_SLOT});
+
+  return true;
+}
+
+bool DiskRecorder::acquire() {
+  {
+    std::lock_guard<std::mutex> guard{queue_mtx_};
+
+    if (free_.empty()) return false;
+
+    current_ = free_.back();
+    free_.pop_back();
+  }
+
+  fill_ = 0;
+  current_offset_ = next_offset_;
+  next_offset_ += opts_.buffer_size;
+
+  return true;
+}
+
+void DiskRecorder::submit_current(bool shrink) {
+  constexpr std::size_t HDR = sizeof(recording::RecordHeader);
+  std::size_t size = opts_.buffer_size;
+
+  /* The last buffer is cut down to the pages actually used, unless an
+   * oversized record was already placed after it */
+  if (shrink && next_offset_ == current_offset_ + size) {
+    size = std::min(size, page_align(fill_ + HDR));
+  }
+
+  if (fill_ < size) write_pad(slots_[current_] + fill_, size - fill_);
+
+  push({
+      .data = slots_[current_],
+      .size = size,
+      .offset = current_offset_,
+      .slot = current_,
+  });
+
+  current_ = NO_SLOT;
+}
+
+void DiskRecorder::push(Job job) {
+  data_end_ = std::max(data_end_, job.offset + job.size);
+
+  {
+    std::lock_guard<std::mutex> guard{queue_mtx_};
+
+    queue_.push_back(job);
+
+    std::size_t depth = queue_.size() + inflight_;
+
+    if (depth > peak_queue_.load(std::memory_order_relaxed)) {
+      peak_queue_.store(depth, std::memory_order_relaxed);
+    }
+  }
+
+  cv_.notify_one();
+}
+
+void DiskRecorder::release(Job const& job) {
+  std::lock_guard<std::mutex> guard{queue_mtx_};
+
+  if (job.slot == NO_SLOT) {
+    std::free(job.data);
+  } else {
+    free_.push_back(job.slot);
+  }
+
+  inflight_--;
+}
+
+bool DiskRecorder::write_sync(Job const& job) {
+  if (!pwrite_all(fd_, job.data, job.size, job.offset)) {
+    write_errors_.fetch_add(1, std::memory_order_relaxed);
+    logs::log(ERR, "Failed to write IIO recording %s: %s\n", path_.c_str(),
+              std::strerror(errno));
+    return false;
+  }
+
+  bytes_written_.fetch_add(job.size, std::memory_order_relaxed);
+
+  return true;
+}
+
+void DiskRecorder::grow(std::uint64_t end) {
+  std::uint64_t step = opts_.preallocate;
+
+  if (step == 0U || end <= allocated_) return;
+
+  std::uint64_t target = ((end + step - 1U) / step) * step;
+
+  if (fallocate(fd_, 0, static_cast<off_t>(allocated_),
+                static_cast<off_t>(target - allocated_)) < 0) {
+    logs::log(WARN, "Failed to preallocate IIO recording %s: %s\n",
+              path_.c_str(), std::strerror(errno));
+    opts_.preallocate = 0;
+    return;
+  }
+
+  allocated_ = target;
+}
+
+void DiskRecorder::workTask(std::stop_token stoken) {
+  std::vector<Job> batch;
+
+  batch.reserve(slots_.size());
+
+  while (true) {
+    batch.clear();
+
+    {
+      std::unique_lock<std::mutex> lock{queue_mtx_};
+
+      if (inflight_ == 0U &&
+          !cv_.wait(lock, stoken, [this] { return !queue_.empty(); })) {
+        return;
+      }
+
+      batch.assign(queue_.begin(), queue_.end());
+      queue_.clear();
+      inflight_ += batch.size();
+    }
+
+    for (auto const& job : batch) grow(job.offset + job.size);
+
+#ifdef FSATUTILS_HAVE_LIBURING
+    if (uring_) {
+      struct io_uring* ring = &uring_->ring;
+
+      for (auto const& job : batch) {
+        struct io_uring_sqe* sqe = io_uring_get_sqe(ring);
+
+        if (sqe == nullptr) {
+          write_sync(job);
+          release(job);
+          continue;
+        }
+
+        io_uring_prep_write(sqe, fd_, job.data,
+                            static_cast<unsigned>(job.size), job.offset);
+        io_uring_sqe_set_data(sqe, new Job{job});
+      }
+
+      io_uring_submit(ring);
+
+      {
+        std::lock_guard<std::mutex> guard{queue_mtx_};
+        if (inflight_ == 0U) continue;
+      }
+
+      struct io_uring_cqe* cqe;
+
+      if (io_uring_wait_cqe(ring, &cqe) < 0) continue;
+
+      do {
+        auto* job = static_cast<Job*>(io_uring_cqe_get_data(cqe));
+
+        if (cqe->res < 0 || static_cast<std::size_t>(cqe->res) != job->size) {
+          write_errors_.fetch_add(1, std::memory_order_relaxed);
+          logs::log(ERR, "Failed to write IIO recording %s: %s\n",
+                    path_.c_str(),
+                    std::strerror(cqe->res < 0 ? -cqe->res : ENOSPC));
+        } else {
+          bytes_written_.fetch_add(job->size, std::memory_order_relaxed);
+        }
+
+        io_uring_cqe_seen(ring, cqe);
+        release(*job);
+        delete job;
+      } while (io_uring_peek_cqe(ring, &cqe) == 0);
+
+      continue;
+    }
+#endif
+
+    for (auto const& job : batch) {
+      write_sync(job);
+      release(job);
+    }
+  }
+}
+
+}  // namespace iio
+
+}  // namespace fsatutils
@@ -0,0 +1,337 @@
+#include <cmath>
+#include <cstring>
+#include <fsatutils/errors.hpp>
+#include <fsatutils/iio/dsp.hpp>
+#include <limits>
+
+namespace fsatutils {
+
+namespace iio {
+
+namespace {
+
+/* Generic vectors let GCC emit SSE/AVX or NEON from the same source; loads go
+ * through memcpy since sample spans carry no alignment guarantee. */
+constexpr std::size_t LANES = 4;
+
+using vfloat = float __attribute__((vector_size(LANES * sizeof(float))));
+
+inline vfloat load(const float* p) {
+  vfloat v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline vfloat splat(float x) {
+  vfloat v;
+  for (std::size_t l = 0; l < LANES; l++) v[l] = x;
+  return v;
+}
+
+float dot(const float* a, const float* b, std::size_t n) {
+  vfloat acc0 = {};
+  vfloat acc1 = {};
+  std::size_t i = 0;
+
+  for (; i + 2 * LANES <= n; i += 2 * LANES) {
+    acc0 += load(a + i) * load(b + i);
+    acc1 += load(a + i + LANES) * load(b + i + LANES);
+  }
+
+  for (; i + LANES <= n; i += LANES) acc0 += load(a + i) * load(b + i);
+
+  acc0 += acc1;
+
+  float sum = 0.0F;
+
+  for (std::size_t l = 0; l < LANES; l++) sum += acc0[l];
+  for (; i < n; i++) sum += a[i] * b[i];
+
+  return sum;
+}
+
+struct Summary {
+  float min;
+  float max;
+  double sum;
+};
+
+Summary summarize(const float* p, std::size_t n) {
+  vfloat vmin = splat(std::numeric_limits<float>::infinity());
+  vfloat vmax = -vmin;
+  vfloat vsum = {};
+  std::size_t i = 0;
+
+  for (; i + LANES <= n; i += LANES) {
+    vfloat v = load(p + i);
+    vmin = v < vmin ? v : vmin;
+    vmax = v > vmax ? v : vmax;
+    vsum += v;
+  }
+
+  Summary s = {vmin[0], vmax[0], 0.0};
+
+  for (std::size_t l = 0; l < LANES; l++) {
+    s.min = std::min(s.min, vmin[l]);
+    s.max = std::max(s.max, vmax[l]);
+    s.sum += vsum[l];
+  }
+
+  for (; i < n; i++) {
+    s.min = std::min(s.min, p[i]);
+    s.max = std::max(s.max, p[i]);
+    s.sum += p[i];
+  }
+
+  return s;
+}
+
+}  // namespace
+
+Decimator::Decimator(std::size_t factor, Reduce mode)
+    : factor_{factor}, mode_{mode} {
+  if (factor_ == 0U) {
+    throw_runtime_error("Decimation factor must be greater than zero!");
+  }
+
+  reset();
+}
+
+void Decimator::reset() {
+  count_ = 0;
+  min_ = std::numeric_limits<float>::infinity();
+  max_ = -std::numeric_limits<float>::infinity();
+  sum_ = 0.0;
+}
+
+std::size_t Decimator::max_output(std::size_t input) const {
+  return (input + factor_ - 1) / factor_;
+}
+
+std::span<const float> Decimator::process(std::span<const float> in) {
+  auto out = output(in.size());
+  std::size_t produced = 0;
+  std::size_t i = 0;
+
+  while (i < in.size()) {
+    std::size_t chunk = std::min(factor_ - count_, in.size() - i);
+    Summary s = summarize(in.data() + i, chunk);
+
+    min_ = std::min(min_, s.min);
+    max_ = std::max(max_, s.max);
+    sum_ += s.sum;
+    count_ += chunk;
+    i += chunk;
+
+    if (count_ < factor_) break;
+
+    switch (mode_) {
+      case Reduce::MIN:
+        out[produced++] = min_;
+        break;
+      case Reduce::MAX:
+        out[produced++] = max_;
+        break;
+      case Reduce::MEAN:
+        out[produced++] = static_cast<float>(sum_ / factor_);
+        break;
+    }
+
+    reset();
+  }
+
+  return out.first(produced);
+}
+
+MovingStats::MovingStats(std::size_t window, Statistic stat)
+    : stat_{stat}, window_(window, 0.0F) {
+  if (window == 0U) {
+    throw_runtime_error("Moving statistics window must not be empty!");
+  }
+}
+
+void MovingStats::reset() {
+  std::fill(window_.begin(), window_.end(), 0.0F);
+  pos_ = 0;
+  filled_ = 0;
+  sum_ = 0.0;
+  sum_sq_ = 0.0;
+}
+
+std::span<const float> MovingStats::process(std::span<const float> in) {
+  auto out = output(in.size());
+
+  for (std::size_t i = 0; i < in.size(); i++) {
+    double x = in[i];
+    double old = window_[pos_];
+
+    sum_ += x - old;
+    sum_sq_ += x * x - old * old;
+    window_[pos_] = in[i];
+
+    if (filled_ < window_.size()) filled_++;
+
+    if (++pos_ == window_.size()) {
+      pos_ = 0;
+
+      /* Resum once per window so rounding in the running sums can't drift;
+       * in double, the float kernels would lose more than they fix */
+      sum_ = 0.0;
+      sum_sq_ = 0.0;
+
+      for (float v : window_) {
+        sum_ += v;
+        sum_sq_ += static_cast<double>(v) * v;
+      }
+    }
+
+    double mean = sum_ / filled_;
+    double var = std::max(0.0, sum_sq_ / filled_ - mean * mean);
+
+    switch (stat_) {
+      case Statistic::MEAN:
+        out[i] = static_cast<float>(mean);
+        break;
+      case Statistic::VARIANCE:
+        out[i] = static_cast<float>(var);
+        break;
+      case Statistic::RMS:
+        out[i] = static_cast<float>(std::sqrt(sum_sq_ / filled_));
+        break;
+    }
+  }
+
+  return out.first(in.size());
+}
+
+Fir::Fir(std::vector<float> taps, std::size_t decimation)
+    : taps_{taps.rbegin(), taps.rend()}, decimation_{decimation} {
+  if (taps_.empty() || decimation_ == 0U) {
+    throw_runtime_error("FIR filter needs taps and a non-zero decimation!");
+  }
+
+  reset();
+}
+
+void Fir::reset() {
+  phase_ = 0;
+  work_.assign(taps_.size() - 1, 0.0F);
+}
+
+std::size_t Fir::max_output(std::size_t input) const {
+  return (input + decimation_ - 1) / decimation_;
+}
+
+void Fir::reserve(std::size_t max_block) {
+  Stage::reserve(max_block);
+  work_.reserve(taps_.size() - 1 + max_block);
+}
+
+std::span<const float> Fir::process(std::span<const float> in) {
+  auto out = output(in.size());
+  std::size_t history = taps_.size() - 1;
+  std::size_t produced = 0;
+
+  work_.resize(history + in.size());
+  std::copy(in.begin(), in.end(), work_.begin() + history);
+
+  for (std::size_t i = 0; i < in.size(); i++) {
+    if (phase_ == 0U) {
+      out[produced++] = dot(taps_.data(), work_.data() + i, taps_.size());
+    }
+
+    if (++phase_ == decimation_) phase_ = 0;
+  }
+
+  std::copy(work_.end() - history, work_.end(), work_.begin());
+  work_.resize(history);
+
+  return out.first(produced);
+}
+
+Cic::Cic(std::size_t order, std::size_t decimation, std::size_t delay)
+    : decimation_{decimation},
+      delay_{delay},
+      integrators_(order, 0),
+      combs_(order * delay, 0) {
+  if (order == 0U || decimation_ == 0U || delay_ == 0U) {
+    throw_runtime_error("CIC order, decimation and delay must be non-zero!");
+  }
+
+  gain_ = std::pow(static_cast<double>(decimation_ * delay_),
+                   static_cast<double>(order));
+}
+
+void Cic::reset() {
+  phase_ = 0;
+  std::fill(integrators_.begin(), integrators_.end(), 0);
+  std::fill(combs_.begin(), combs_.end(), 0);
+}
+
+std::size_t Cic::max_output(std::size_t input) const {
+  return (input + decimation_ - 1) / decimation_;
+}
+
+std::span<const float> Cic::process(std::span<const float> in) {
+  auto out = output(in.size());
+  std::size_t produced = 0;
+
+  for (float x : in) {
+    /* Two's complement wrap-around is what makes CIC integrators work, so
+     * accumulate in unsigned arithmetic to keep it well defined */
+    auto acc = static_cast<std::uint64_t>(std::llround(x));
+
+    for (auto& integ : integrators_) {
+      acc += static_cast<std::uint64_t>(integ);
+      integ = static_cast<std::int64_t>(acc);
+    }
+
+    if (++phase_ < decimation_) continue;
+
+    phase_ = 0;
+
+    for (std::size_t s = 0; s < integrators_.size(); s++) {
+      std::int64_t* d = combs_.data() + s * delay_;
+      std::uint64_t prev = static_cast<std::uint64_t>(d[delay_ - 1]);
+
+      std::memmove(d + 1, d, (delay_ - 1) * sizeof(*d));
+      d[0] = static_cast<std::int64_t>(acc);
+      acc -= prev;
+    }
+
+    out[produced++] =
+        static_cast<float>(static_cast<std::int64_t>(acc) / gain_);
+  }
+
+  return out.first(produced);
+}
+
+Pipeline& Pipeline::add(std::unique_ptr<Stage> stage) {
+  stages_.push_back(std::move(stage));
+  return *this;
+}
+
+void Pipeline::reserve(std::size_t max_block) {
+  for (auto& stage : stages_) {
+    stage->reserve(max_block);
+    max_block = stage->max_output(max_block);
+  }
+}
+
+std::span<const float> Pipeline::process(std::span<const float> in) {
+  for (auto& stage : stages_) {
+    in = stage->process(in);
+
+    if (in.empty()) break;
+  }
+
+  return in;
+}
+
+void Pipeline::reset() {
+  for (auto& stage : stages_) stage->reset();
+}
+
+}  // namespace iio
+
+}  // namespace fsatutils
@@ -0,0 +1,261 @@
+#include <fcntl.h>
+#include <iio.h>
+#include <linux/iio/events.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fsatutils/errors.hpp>
+#include <fsatutils/iio/event.hpp>
+#include <fsatutils/log/log.hpp>
+#include <fstream>
+
+namespace fsatutils {
+
+namespace iio {
+
+namespace {
+
+constexpr std::size_t EVENT_BATCH = 16U;
+
+const std::string SYSFS_DEVICES = "/sys/bus/iio/devices/";
+
+}  // namespace
+
+EventStream::EventStream(Device& dev) : device_id_{iio_device_get_id(dev)} {
+  std::string path = "/dev/" + device_id_;
+  int dev_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (dev_fd < 0) {
+    throw_runtime_error("Failed to open " + path + " for IIO events!");
+  }
+
+  int res = ioctl(dev_fd, IIO_GET_EVENT_FD_IOCTL, &fd_);
+
+  ::close(dev_fd);
+
+  if (res < 0 || fd_ < 0) {
+    throw_runtime_error(device_id_ + " IIO Device does not support events!");
+  }
+
+  int flags = fcntl(fd_, F_GETFL);
+
+  if (flags < 0 || fcntl(fd_, F_SETFL, flags | O_NONBLOCK) < 0 ||
+      fcntl(fd_, F_SETFD, FD_CLOEXEC) < 0) {
+    ::close(fd_);
+    throw_runtime_error("Failed to configure " + device_id_ + " event fd!");
+  }
+}
+
+EventStream::~EventStream() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+EventStream::EventStream(EventStream&& other) noexcept
+    : device_id_{std::move(other.device_id_)}, fd_{other.fd_} {
+  other.fd_ = -1;
+}
+
+EventStream& EventStream::operator=(EventStream&& other) noexcept {
+  if (this != &other) {
+    if (fd_ >= 0) ::close(fd_);
+
+    device_id_ = std::move(other.device_id_);
+    fd_ = other.fd_;
+    other.fd_ = -1;
+  }
+
+  return *this;
+}
+
+std::size_t EventStream::read(std::span<Event> events) {
+  std::array<struct iio_event_data, EVENT_BATCH> raw;
+  std::size_t count = 0;
+
+  while (count < events.size()) {
+    std::size_t want = std::min(raw.size(), events.size() - count);
+    ssize_t res = ::read(fd_, raw.data(), want * sizeof(raw[0]));
+
+    if (res < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+
+      throw_runtime_error("Failed to read " + device_id_ + " IIO events!");
+    }
+
+    std::size_t got = static_cast<std::size_t>(res) / sizeof(raw[0]);
+
+    for (std::size_t i = 0; i < got; i++) {
+      events[count++] = decode(raw[i].id, raw[i].timestamp);
+    }
+
+    if (got < want) break;
+  }
+
+  return count;
+}
+
+std::optional<Event> EventStream::next(std::chrono::milliseconds timeout) {
+  Event ev;
+
+  if (read({&ev, 1U}) == 1U) return ev;
+
+  struct pollfd pfd = {.fd = fd_, .events = POLLIN, .revents = 0};
+  int res = poll(&pfd, 1, static_cast<int>(timeout.count()));
+
+  if (res < 0 && errno != EINTR) {
+    throw_runtime_error("Failed to poll " + device_id_ + " IIO events!");
+  }
+
+  if (res <= 0) return std::nullopt;
+
+  if (read({&ev, 1U}) == 1U) return ev;
+
+  return std::nullopt;
+}
+
+void EventStream::enable(std::string const& attr, bool enabled) {
+  set(attr, enabled ? "1" : "0");
+}
+
+void EventStream::set(std::string const& attr, std::string const& value) {
+  std::string path = SYSFS_DEVICES + device_id_ + "/events/" + attr;
+  std::ofstream ofs{path};
+
+  ofs << value;
+  ofs.close();
+
+  if (!ofs) {
+    throw_runtime_error("Failed to write " + attr + " event attribute!");
+  }
+}
+
+Event EventStream::decode(std::uint64_t id, std::int64_t timestamp) {
+  return {
+      .id = id,
+      .timestamp_ns = timestamp,
+      .chan_type =
+          static_cast<enum iio_chan_type>(IIO_EVENT_CODE_EXTRACT_CHAN_TYPE(id)),
+      .channel = IIO_EVENT_CODE_EXTRACT_CHAN(id),
+      .channel2 = IIO_EVENT_CODE_EXTRACT_CHAN2(id),
+      .modifier =
+          static_cast<std::uint8_t>(IIO_EVENT_CODE_EXTRACT_MODIFIER(id)),
+      .differential = IIO_EVENT_CODE_EXTRACT_DIFF(id) != 0U,
+      .type = static_cast<EventType>(IIO_EVENT_CODE_EXTRACT_TYPE(id)),
+      .direction = static_cast<EventDirection>(IIO_EVENT_CODE_EXTRACT_DIR(id)),
+  };
+}
+
+EventReactor::EventReactor() : epfd_{epoll_create1(EPOLL_CLOEXEC)} {
+  if (epfd_ < 0) {
+    throw_runtime_error("Failed to create IIO event reactor!");
+  }
+}
+
+EventReactor::~EventReactor() { ::close(epfd_); }
+
+void EventReactor::add(EventStream& stream, Handler handler) {
+  struct epoll_event ev = {};
+
+  ev.events = EPOLLIN;
+  ev.data.fd = stream.fd();
+
+  if (epoll_ctl(epfd_, EPOLL_CTL_ADD, stream.fd(), &ev) < 0) {
+    throw_runtime_error("Failed to watch " + stream.device_id() +
+                        " IIO events!");
+  }
+
+  Watch watch{.stream = &stream, .handler = std::move(handler),
+              .removed = false};
+
+  /* Replacing a handler could destroy the one that is running */
+  if (dispatching_) {
+    added_.emplace_back(stream.fd(), std::move(watch));
+    return;
+  }
+
+  handlers_[stream.fd()] = std::move(watch);
+}
+
+void EventReactor::remove(EventStream& stream) {
+  int fd = stream.fd();
+
+  epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+
+  std::erase_if(added_, [fd](auto const& a) { return a.first == fd; });
+
+  if (!dispatching_) {
+    handlers_.erase(fd);
+    return;
+  }
+
+  if (auto it = handlers_.find(fd); it != handlers_.end()) {
+    it->second.removed = true;
+  }
+}
+
+std::size_t EventReactor::run_once(std::chrono::milliseconds timeout) {
+  std::array<struct epoll_event, EVENT_BATCH> ready;
+  std::array<Event, EVENT_BATCH> events;
+  std::size_t dispatched = 0;
+
+  int n = epoll_wait(epfd_, ready.data(), static_cast<int>(ready.size()),
+                     static_cast<int>(timeout.count()));
+
+  if (n < 0) {
+    if (errno != EINTR) logs::log(ERR, "IIO event reactor wait failed!\n");
+    return 0;
+  }
+
+  dispatching_ = true;
+
+  try {
+    for (int i = 0; i < n; i++) {
+      auto it = handlers_.find(ready[i].data.fd);
+
+      if (it == handlers_.end()) continue;
+
+      Watch& watch = it->second;
+      std::size_t count;
+
+      while (!watch.removed && (count = watch.stream->read(events)) > 0) {
+        for (std::size_t j = 0; j < count && !watch.removed; j++) {
+          watch.handler(*watch.stream, events[j]);
+          dispatched++;
+        }
+      }
+    }
+  } catch (...) {
+    settle();
+    throw;
+  }
+
+  settle();
+
+  return dispatched;
+}
+
+void EventReactor::settle() {
+  dispatching_ = false;
+
+  std::erase_if(handlers_, [](auto const& h) { return h.second.removed; });
+
+  for (auto& [fd, watch] : added_) handlers_[fd] = std::move(watch);
+
+  added_.clear();
+}
+
+void EventReactor::run(std::stop_token stoken, std::chrono::milliseconds tick) {
+  while (!stoken.stop_requested()) run_once(tick);
+}
+
+}  // namespace iio
+
+}  // namespace fsatutils
@@ -0,0 +1,289 @@
+#include <iio.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fsatutils/errors.hpp>
+#include <fsatutils/iio/device.hpp>
+#include <fsatutils/iio/profile.hpp>
+#include <fsatutils/iio/recording.hpp>
+#include <fsatutils/log/log.hpp>
+#include <fstream>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <sstream>
+
+namespace fsatutils {
+
+namespace iio {
+
+namespace {
+
+std::string to_attr_value(nlohmann::json const& value) {
+  if (value.is_string()) return value.get<std::string>();
+  if (value.is_boolean()) return value.get<bool>() ? "1" : "0";
+  if (value.is_number()) return value.dump();
+
+  throw_runtime_error("Unsupported profile attribute value " + value.dump());
+}
+
+std::string_view trim(std::string_view s) {
+  auto first = s.find_first_not_of(" \t\r\n");
+  if (first == std::string_view::npos) return {};
+
+  auto last = s.find_last_not_of(" \t\r\n");
+  return s.substr(first, last - first + 1);
+}
+
+std::optional<double> parse_number(std::string const& s) {
+  char* end;
+  double v = std::strtod(s.c_str(), &end);
+
+  if (end == s.c_str() || *end != '\0') return std::nullopt;
+
+  return v;
+}
+
+/* The kernel often formats values differently from how they were written
+ * ("10" reads back as "10.000000"), so numbers are compared by value */
+bool same_value(std::string_view current, std::string_view wanted) {
+  current = trim(current);
+  wanted = trim(wanted);
+
+  if (current == wanted) return true;
+
+  auto a = parse_number(std::string{current});
+  auto b = parse_number(std::string{wanted});
+
+  if (!a || !b) return false;
+
+  return std::fabs(*a - *b) <=
+         1e-9 * std::max({1.0, std::fabs(*a), std::fabs(*b)});
+}
+
+using AttrMap = std::map<std::string, std::string, std::less<>>;
+
+bool read_all(struct iio_channel* ch, AttrMap& values) {
+  auto cb = [](struct iio_channel*, const char* attr, const char* val,
+               std::size_t len, void* d) -> int {
+    (*static_cast<AttrMap*>(d))[attr] = std::string{val, strnlen(val, len)};
+    return 0;
+  };
+
+  return iio_channel_attr_read_all(ch, cb, &values) >= 0;
+}
+
+bool write_all(struct iio_channel* ch, AttrMap const& values) {
+  auto cb = [](struct iio_channel*, const char* attr, void* buf,
+               std::size_t len, void* d) -> ssize_t {
+    auto const& wanted = *static_cast<AttrMap const*>(d);
+    auto it = wanted.find(std::string_view{attr});
+
+    /* A zero length leaves the attribute untouched */
+    if (it == wanted.end()) return 0;
+    if (it->second.size() + 1U > len) return -ENOMEM;
+
+    std::memcpy(buf, it->second.c_str(), it->second.size() + 1U);
+    return static_cast<ssize_t>(it->second.size() + 1U);
+  };
+
+  return iio_channel_attr_write_all(
+             ch, cb, const_cast<void*>(static_cast<void const*>(&values))) >=
+         0;
+}
+
+}  // namespace
+
+Profile Profile::from_json(std::string_view json) {
+  Profile profile;
+  nlohmann::json j;
+
+  try {
+    j = nlohmann::json::parse(json);
+
+    for (auto const& dev : j.at("devices")) {
+      std::string dev_name = dev.at("name").get<std::string>();
+
+      for (auto const& chan : dev.at("channels")) {
+        std::string chan_name = chan.at("name").get<std::string>();
+        bool output = chan.value("output", false);
+
+        for (auto const& [attr, value] : chan.at("attrs").items()) {
+          profile.set(dev_name, chan_name, output, attr, to_attr_value(value));
+        }
+      }
+    }
+  } catch (const nlohmann::json::exception& e) {
+    throw_runtime_error(std::string{"Invalid IIO profile: "} + e.what());
+  }
+
+  return profile;
+}
+
+Profile Profile::from_file(std::string const& path) {
+  std::ifstream ifs{path};
+
+  if (!ifs) {
+    throw_runtime_error("Failed to open IIO profile " + path);
+  }
+
+  std::ostringstream oss;
+  oss << ifs.rdbuf();
+
+  return from_json(oss.str());
+}
+
+void Profile::set(std::string const& device, std::string const& channel,
+                  bool output, std::string const& attr, std::string value) {
+  auto dev = std::find_if(devices_.begin(), devices_.end(),
+                          [&device](auto& d) { return d.device == device; });
+
+  if (dev == devices_.end()) {
+    devices_.push_back({device, {}});
+    dev = std::prev(devices_.end());
+  }
+
+  auto& settings = dev->settings;
+  auto it = std::find_if(settings.begin(), settings.end(), [&](auto& s) {
+    return s.channel == channel && s.output == output && s.attr == attr;
+  });
+
+  if (it != settings.end()) {
+    it->value = std::move(value);
+    return;
+  }
+
+  settings.push_back({channel, output, attr, std::move(value)});
+}
+
+Profile::ApplyStats Profile::apply(std::shared_ptr<Context> ctx,
+                                   StateCache* cache) {
+  ApplyStats stats = {};
+  StateCache local;
+  StateCache& state = cache != nullptr ? *cache : local;
+
+  /* Bulk requests go straight to libiio, which would bypass a replay's
+   * attribute snapshot, so replayed contexts take the per-attribute path */
+  bool bulk = ctx->replay() == nullptr;
+
+  for (auto const& dp : devices_) {
+    std::optional<Device> dev;
+
+    try {
+      dev.emplace(ctx, dp.device);
+    } catch (const std::exception& e) {
+      logs::log(ERR, "Skipping profile of %s: %s\n", dp.device.c_str(),
+                e.what());
+      stats.failed += dp.settings.size();
+      continue;
+    }
+
+    std::map<std::pair<std::string, bool>, std::vector<AttrSetting const*>>
+        channels;
+
+    for (auto const& s : dp.settings) {
+      channels[{s.channel, s.output}].push_back(&s);
+    }
+
+    for (auto const& [chan_key, settings] : channels) {
+      auto const& [chan_name, output] = chan_key;
+      std::optional<Channel> ch;
+
+      try {
+        ch.emplace(dev->find_device_channel(chan_name, output));
+      } catch (const std::exception& e) {
+        logs::log(ERR, "Skipping profile of %s/%s: %s\n", dp.device.c_str(),
+                  chan_name.c_str(), e.what());
+        stats.failed += settings.size();
+        continue;
+      }
+
+      auto key = [&](AttrSetting const* s) {
+        return recording::attr_key(dp.device, chan_name, output, s->attr);
+      };
+
+      std::size_t missing = std::count_if(
+          settings.begin(), settings.end(),
+          [&](auto* s) { return !state.contains(key(s)); });
+
+      if (bulk && missing > 1U) {
+        AttrMap current;
+
+        stats.round_trips++;
+
+        if (read_all(*ch, current)) {
+          for (auto& [attr, value] : current) {
+            state[recording::attr_key(dp.device, chan_name, output, attr)] =
+                std::move(value);
+          }
+        }
+      }
+
+      AttrMap changed;
+
+      for (auto* s : settings) {
+        stats.checked++;
+
+        auto it = state.find(key(s));
+
+        if (it == state.end()) {
+          try {
+            stats.round_trips++;
+            it = state.emplace(key(s), ch->read_attr<std::string>(s->attr))
+                     .first;
+          } catch (const std::exception&) {
+            /* Unreadable attributes are written unconditionally */
+          }
+        }
+
+        if (it != state.end() && same_value(it->second, s->value)) {
+          stats.unchanged++;
+          continue;
+        }
+
+        changed[s->attr] = s->value;
+      }
+
+      if (changed.empty()) continue;
+
+      if (bulk && changed.size() > 1U) {
+        stats.round_trips++;
+
+        if (write_all(*ch, changed)) {
+          for (auto& [attr, value] : changed) {
+            state[recording::attr_key(dp.device, chan_name, output, attr)] =
+                value;
+          }
+
+          stats.written += changed.size();
+          continue;
+        }
+      }
+
+      for (auto& [attr, value] : changed) {
+        std::string k = recording::attr_key(dp.device, chan_name, output, attr);
+
+        try {
+          stats.round_trips++;
+          ch->write_attr<std::string>(attr, value);
+          state[k] = value;
+          stats.written++;
+        } catch (const std::exception& e) {
+          logs::log(ERR, "Failed to apply %s = %s: %s\n", k.c_str(),
+                    value.c_str(), e.what());
+          state.erase(k);
+          stats.failed++;
+        }
+      }
+    }
+  }
+
+  return stats;
+}
+
+}  // namespace iio
+
+}  // namespace fsatutils
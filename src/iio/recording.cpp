@@ -0,0 +1,600 @@
+#include <fcntl.h>
+#include <iio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fsatutils/errors.hpp>
+#include <fsatutils/iio/recording.hpp>
+#include <fsatutils/log/log.hpp>
+#include <iterator>
+#include <thread>
+
+namespace fsatutils {
+
+namespace iio {
+
+namespace {
+
+class ByteWriter {
+ public:
+  template <typename T>
+  void put(T value) {
+    auto p = reinterpret_cast<const std::uint8_t*>(&value);
+    bytes_.insert(bytes_.end(), p, p + sizeof(T));
+  }
+
+  void put(std::string_view str) {
+    bytes_.insert(bytes_.end(), str.begin(), str.end());
+  }
+
+  std::vector<std::uint8_t> take() { return std::move(bytes_); }
+
+ private:
+  std::vector<std::uint8_t> bytes_;
+};
+
+class ByteReader {
+ public:
+  ByteReader(const std::uint8_t* data, std::size_t size)
+      : p_{data}, end_{data + size} {}
+
+  template <typename T>
+  T get() {
+    T value;
+    std::memcpy(&value, take(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  std::string_view str(std::size_t len) {
+    return {reinterpret_cast<const char*>(take(len)), len};
+  }
+
+ private:
+  const std::uint8_t* take(std::size_t len) {
+    if (static_cast<std::size_t>(end_ - p_) < len) {
+      throw_runtime_error("Truncated IIO recording record!");
+    }
+
+    const std::uint8_t* p = p_;
+    p_ += len;
+    return p;
+  }
+
+  const std::uint8_t* p_;
+  const std::uint8_t* end_;
+};
+
+}  // namespace
+
+namespace recording {
+
+std::vector<std::uint8_t> encode_layout(std::string_view device,
+                                        std::size_t step,
+                                        std::vector<ChannelLayout> const& l) {
+  ByteWriter w;
+
+  w.put(static_cast<std::uint32_t>(step));
+  w.put(static_cast<std::uint16_t>(device.size()));
+  w.put(static_cast<std::uint16_t>(l.size()));
+  w.put(device);
+
+  for (auto const& ch : l) {
+    w.put(static_cast<std::uint32_t>(ch.offset));
+    w.put(static_cast<std::uint32_t>(ch.length));
+    w.put(static_cast<std::uint16_t>(ch.id.size()));
+    w.put(std::string_view{ch.id});
+  }
+
+  return w.take();
+}
+
+std::string attr_key(std::string_view device, std::string_view channel,
+                     bool output, std::string_view attr) {
+  std::string key;
+
+  key.reserve(device.size() + channel.size() + attr.size() + 5U);
+  key.append(device).append("/").append(channel);
+  key.append(output ? "/o/" : "/i/").append(attr);
+
+  return key;
+}
+
+std::uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace recording
+
+Recorder::Recorder(std::shared_ptr<Context> ctx, std::string path,
+                   std::size_t chunk_size)
+    : ctx_{std::move(ctx)}, path_{std::move(path)}, chunk_{chunk_size} {
+  fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+  if (fd_ < 0) {
+    throw_runtime_error("Failed to open IIO recording " + path_ + "!");
+  }
+
+  std::string_view xml{iio_context_get_xml(*ctx_)};
+
+  recording::FileHeader hdr{};
+
+  std::memcpy(hdr.magic, recording::MAGIC, sizeof(hdr.magic));
+  hdr.version = recording::VERSION;
+  hdr.description_offset = sizeof(recording::FileHeader);
+  hdr.description_size = xml.size();
+  hdr.data_offset = recording::align(sizeof(hdr) + xml.size());
+  hdr.start_ns = recording::now_ns();
+
+  std::uint8_t* p = reserve(hdr.data_offset);
+
+  std::memcpy(p, &hdr, sizeof(hdr));
+  std::memcpy(p + sizeof(hdr), xml.data(), xml.size());
+
+  used_ = hdr.data_offset;
+}
+
+Recorder::~Recorder() {
+  try {
+    close();
+  } catch (const std::exception& e) {
+    logs::log(ERR, "Failed to finalize IIO recording: %s\n", e.what());
+  }
+}
+
+void Recorder::record(Buffer const& buf) {
+  std::lock_guard<std::mutex> guard{mtx_};
+
+  if (fd_ < 0) return;
+
+  std::uint16_t stream = stream_for(buf);
+
+  append(recording::RecordType::BLOCK, stream, buf.timestamp(), {buf.data()});
+}
+
+void Recorder::snapshot_attrs(Device& dev) {
+  struct Snapshot {
+    Recorder* self;
+    std::string_view device;
+    std::string_view channel;
+    bool output;
+    std::uint64_t ts;
+  };
+
+  auto cb = [](struct iio_channel*, const char* attr, const char* val,
+               std::size_t len, void* d) -> int {
+    auto s = static_cast<Snapshot*>(d);
+    std::string_view a{attr};
+    std::string_view v{val, strnlen(val, len)};
+
+    ByteWriter w;
+    w.put(static_cast<std::uint16_t>(s->device.size()));
+    w.put(static_cast<std::uint16_t>(s->channel.size()));
+    w.put(static_cast<std::uint16_t>(a.size()));
+    w.put(static_cast<std::uint8_t>(s->output));
+    w.put(static_cast<std::uint8_t>(0U));
+    w.put(static_cast<std::uint32_t>(v.size()));
+    w.put(s->device);
+    w.put(s->channel);
+    w.put(a);
+    w.put(v);
+
+    auto bytes = w.take();
+    s->self->append(recording::RecordType::ATTR, 0, s->ts, {bytes});
+
+    return 0;
+  };
+
+  std::lock_guard<std::mutex> guard{mtx_};
+
+  if (fd_ < 0) return;
+
+  unsigned int count = iio_device_get_channels_count(dev);
+
+  for (unsigned int i = 0; i < count; i++) {
+    struct iio_channel* ch = iio_device_get_channel(dev, i);
+    Snapshot s{
+        .self = this,
+        .device = iio_device_get_id(dev),
+        .channel = iio_channel_get_id(ch),
+        .output = iio_channel_is_output(ch),
+        .ts = recording::now_ns(),
+    };
+
+    if (iio_channel_attr_read_all(ch, cb, &s) == 0) continue;
+
+    /* Some backends do not support bulk reads, fall back to one by one */
+    unsigned int attrs = iio_channel_get_attrs_count(ch);
+    std::array<char, 1024U> val;
+
+    for (unsigned int j = 0; j < attrs; j++) {
+      const char* attr = iio_channel_get_attr(ch, j);
+      ssize_t res = iio_channel_attr_read(ch, attr, val.data(), val.size());
+
+      if (res < 0) {
+        logs::log(WARN, "Failed to snapshot %s attribute of channel %s\n",
+                  attr, iio_channel_get_id(ch));
+        continue;
+      }
+
+      cb(ch, attr, val.data(), static_cast<std::size_t>(res), &s);
+    }
+  }
+}
+
+void Recorder::close() {
+  std::lock_guard<std::mutex> guard{mtx_};
+
+  if (fd_ < 0) return;
+
+  std::size_t index_size = index_.size() * sizeof(recording::IndexEntry);
+  std::uint8_t* p = reserve(index_size);
+
+  std::memcpy(p, index_.data(), index_size);
+
+  recording::FileHeader hdr;
+  std::memcpy(&hdr, map_, sizeof(hdr));
+
+  hdr.index_offset = used_;
+  hdr.index_count = index_.size();
+  hdr.stream_count = static_cast<std::uint32_t>(streams_.size());
+
+  std::memcpy(map_, &hdr, sizeof(hdr));
+
+  used_ += index_size;
+
+  msync(map_, used_, MS_SYNC);
+  munmap(map_, mapped_);
+
+  if (ftruncate(fd_, static_cast<off_t>(used_)) < 0) {
+    logs::log(ERR, "Failed to truncate IIO recording %s\n", path_.c_str());
+  }
+
+  ::close(fd_);
+
+  map_ = nullptr;
+  mapped_ = 0;
+  fd_ = -1;
+}
+
+std::uint8_t* Recorder::reserve(std::size_t bytes) {
+  if (used_ + bytes <= mapped_) return map_ + used_;
+
+  std::size_t size = ((used_ + bytes + chunk_ - 1U) / chunk_) * chunk_;
+
+  if (ftruncate(fd_, static_cast<off_t>(size)) < 0) {
+    throw_runtime_error("Failed to grow IIO recording " + path_ + "!");
+  }
+
+  void* map = (map_ == nullptr)
+                  ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         fd_, 0)
+                  : mremap(map_, mapped_, size, MREMAP_MAYMOVE);
+
+  if (map == MAP_FAILED) {
+    throw_runtime_error("Failed to map IIO recording " + path_ + "!");
+  }
+
+  map_ = static_cast<std::uint8_t*>(map);
+  mapped_ = size;
+
+  return map_ + used_;
+}
+
+void Recorder::append(
+    recording::RecordType type, std::uint16_t stream, std::uint64_t ts,
+    std::initializer_list<std::span<const std::uint8_t>> parts) {
+  std::size_t payload = 0;
+
+  for (auto const& part : parts) payload += part.size();
+
+  std::size_t total =
+      recording::align(sizeof(recording::RecordHeader) + payload);
+  std::uint8_t* p = reserve(total);
+
+  recording::RecordHeader rh{
+      .type = type,
+      .reserved = 0,
+      .stream = stream,
+      .size = static_cast<std::uint32_t>(payload),
+      .timestamp_ns = ts,
+  };
+
+  std::memcpy(p, &rh, sizeof(rh));
+
+  std::uint8_t* dst = p + sizeof(rh);
+
+  for (auto const& part : parts) {
+    std::memcpy(dst, part.data(), part.size());
+    dst += part.size();
+  }
+
+  std::memset(dst, 0, static_cast<std::size_t>(p + total - dst));
+
+  index_.push_back({
+      .offset = used_,
+      .timestamp_ns = ts,
+      .type = type,
+      .reserved = 0,
+      .stream = stream,
+      .size = rh.size,
+  });
+
+  used_ += total;
+}
+
+std::uint16_t Recorder::stream_for(Buffer const& buf) {
+  auto layout = recording::encode_layout(buf.device_id(), buf.step(),
+                                         buf.layout());
+
+  for (std::size_t i = 0; i < streams_.size(); i++) {
+    if (streams_[i] == layout) return static_cast<std::uint16_t>(i);
+  }
+
+  auto stream = static_cast<std::uint16_t>(streams_.size());
+
+  append(recording::RecordType::LAYOUT, stream, recording::now_ns(), {layout});
+
+  streams_.push_back(std::move(layout));
+
+  return stream;
+}
+
+Replay::Replay(std::string const& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0) {
+    throw_runtime_error("Failed to open IIO recording " + path + "!");
+  }
+
+  struct stat st;
+
+  if (fstat(fd, &st) < 0 ||
+      static_cast<std::size_t>(st.st_size) < sizeof(recording::FileHeader)) {
+    ::close(fd);
+    throw_runtime_error("Invalid IIO recording " + path + "!");
+  }
+
+  size_ = static_cast<std::size_t>(st.st_size);
+
+  void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  ::close(fd);
+
+  if (map == MAP_FAILED) {
+    throw_runtime_error("Failed to map IIO recording " + path + "!");
+  }
+
+  map_ = static_cast<const std::uint8_t*>(map);
+
+  recording::FileHeader hdr;
+  std::memcpy(&hdr, map_, sizeof(hdr));
+
+  if (std::memcmp(hdr.magic, recording::MAGIC, sizeof(hdr.magic)) != 0 ||
+      hdr.version != recording::VERSION ||
+      hdr.description_offset + hdr.description_size > size_) {
+    munmap(const_cast<std::uint8_t*>(map_), size_);
+    throw_runtime_error("Invalid IIO recording " + path + "!");
+  }
+
+  description_ = {reinterpret_cast<const char*>(map_ + hdr.description_offset),
+                  hdr.description_size};
+  start_ns_ = end_ns_ = hdr.start_ns;
+
+  load_index(hdr);
+
+  first_block_ns_ = end_ns_;
+
+  for (auto const& st : streams_) {
+    for (auto const& b : st.blocks) {
+      first_block_ns_ = std::min(first_block_ns_, b.timestamp_ns);
+    }
+  }
+
+  position_ns_.store(start_ns_, std::memory_order_relaxed);
+
+  logs::log(INFO, "Loaded IIO recording %s: %zu streams\n", path.c_str(),
+            streams_.size());
+}
+
+Replay::~Replay() {
+  if (map_ != nullptr) munmap(const_cast<std::uint8_t*>(map_), size_);
+}
+
+void Replay::set_speed(Speed speed, double scale) {
+  speed_ = speed;
+  scale_ = (scale > 0.0) ? scale : 1.0;
+}
+
+std::optional<std::size_t> Replay::find_stream(std::string_view device) const {
+  for (std::size_t i = 0; i < streams_.size(); i++) {
+    if (streams_[i].device == device) return i;
+  }
+
+  return std::nullopt;
+}
+
+std::optional<Replay::Block> Replay::block(std::size_t stream, std::size_t n) {
+  auto const& s = streams_.at(stream);
+
+  if (s.blocks.empty()) return std::nullopt;
+
+  std::size_t lap = n / s.blocks.size();
+
+  if (lap > 0 && !loop_) return std::nullopt;
+
+  auto const& e = s.blocks[n % s.blocks.size()];
+  std::uint64_t ts = e.timestamp_ns + lap * (end_ns_ - start_ns_ + 1U);
+
+  std::call_once(started_,
+                 [this] { wall_start_ = std::chrono::steady_clock::now(); });
+
+  if (speed_ != Speed::MAX && ts > start_ns_) {
+    double scale = (speed_ == Speed::SCALED) ? scale_ : 1.0;
+    auto offset = std::chrono::nanoseconds{
+        static_cast<std::int64_t>(static_cast<double>(ts - start_ns_) / scale)};
+
+    std::this_thread::sleep_until(wall_start_ + offset);
+  }
+
+  std::uint64_t pos = position_ns_.load(std::memory_order_relaxed);
+
+  while (pos < ts && !position_ns_.compare_exchange_weak(pos, ts)) {
+  }
+
+  return Block{
+      .data = {map_ + e.offset + sizeof(recording::RecordHeader), e.size},
+      .timestamp_ns = ts,
+  };
+}
+
+std::optional<std::string> Replay::attr(std::string_view device,
+                                        std::string_view channel, bool output,
+                                        std::string_view attr) const {
+  auto key = recording::attr_key(device, channel, output, attr);
+
+  {
+    std::lock_guard<std::mutex> guard{overrides_mtx_};
+
+    if (auto it = overrides_.find(key); it != overrides_.end()) {
+      return it->second;
+    }
+  }
+
+  auto it = attrs_.find(key);
+
+  if (it == attrs_.end() || it->second.empty()) return std::nullopt;
+
+  /* Serve the latest snapshot taken at or before the current replay
+   * position within its lap; the value was not known yet if there is none */
+  auto const& values = it->second;
+  std::uint64_t pos = position_ns_.load(std::memory_order_relaxed);
+
+  pos = start_ns_ + (pos - start_ns_) % (end_ns_ - start_ns_ + 1U);
+  pos = std::max(pos, first_block_ns_);
+  auto v = std::upper_bound(
+      values.begin(), values.end(), pos,
+      [](std::uint64_t p, auto const& entry) { return p < entry.first; });
+
+  if (v == values.begin()) return std::nullopt;
+
+  return std::string{std::prev(v)->second};
+}
+
+void Replay::write_attr(std::string_view device, std::string_view channel,
+                        bool output, std::string_view attr,
+                        std::string value) {
+  std::lock_guard<std::mutex> guard{overrides_mtx_};
+
+  overrides_[recording::attr_key(device, channel, output, attr)] =
+      std::move(value);
+}
+
+void Replay::load_index(recording::FileHeader const& hdr) {
+  std::size_t index_size = hdr.index_count * sizeof(recording::IndexEntry);
+
+  if (hdr.index_offset != 0 && hdr.index_offset + index_size <= size_) {
+    for (std::size_t i = 0; i < hdr.index_count; i++) {
+      recording::IndexEntry e;
+      std::memcpy(&e, map_ + hdr.index_offset + i * sizeof(e), sizeof(e));
+      add_record(e);
+    }
+
+    return;
+  }
+
+  /* The recording was not closed cleanly, walk the records instead */
+  logs::log(WARN, "IIO recording has no index, scanning records...\n");
+
+  std::size_t off = hdr.data_offset;
+
+  while (off + sizeof(recording::RecordHeader) <= size_) {
+    recording::RecordHeader rh;
+    std::memcpy(&rh, map_ + off, sizeof(rh));
+
+    if (rh.type == recording::RecordType::NONE) break;
+    if (off + sizeof(rh) + rh.size > size_) break;
+
+    if (rh.type == recording::RecordType::PAD) {
+      off += recording::align(sizeof(rh) + rh.size);
+      continue;
+    }
+
+    add_record({
+        .offset = off,
+        .timestamp_ns = rh.timestamp_ns,
+        .type = rh.type,
+        .reserved = 0,
+        .stream = rh.stream,
+        .size = rh.size,
+    });
+
+    off += recording::align(sizeof(rh) + rh.size);
+  }
+}
+
+void Replay::add_record(recording::IndexEntry const& entry) {
+  if (entry.offset + sizeof(recording::RecordHeader) + entry.size > size_) {
+    throw_runtime_error("Corrupted IIO recording index!");
+  }
+
+  ByteReader r{map_ + entry.offset + sizeof(recording::RecordHeader),
+               entry.size};
+
+  if (entry.type == recording::RecordType::LAYOUT ||
+      entry.type == recording::RecordType::BLOCK) {
+    if (entry.stream >= streams_.size()) streams_.resize(entry.stream + 1U);
+  }
+
+  end_ns_ = std::max(end_ns_, entry.timestamp_ns);
+
+  switch (entry.type) {
+    case recording::RecordType::LAYOUT: {
+      auto& s = streams_[entry.stream];
+      s.step = r.get<std::uint32_t>();
+      auto dev_len = r.get<std::uint16_t>();
+      auto count = r.get<std::uint16_t>();
+      s.device = r.str(dev_len);
+      s.layout.clear();
+
+      for (std::uint16_t i = 0; i < count; i++) {
+        ChannelLayout l{};
+        l.offset = r.get<std::uint32_t>();
+        l.length = r.get<std::uint32_t>();
+        l.id = r.str(r.get<std::uint16_t>());
+        s.layout.push_back(std::move(l));
+      }
+      break;
+    }
+    case recording::RecordType::BLOCK:
+      streams_[entry.stream].blocks.push_back(entry);
+      break;
+    case recording::RecordType::ATTR: {
+      auto dev_len = r.get<std::uint16_t>();
+      auto chan_len = r.get<std::uint16_t>();
+      auto attr_len = r.get<std::uint16_t>();
+      bool output = r.get<std::uint8_t>() != 0;
+      r.get<std::uint8_t>();
+      auto val_len = r.get<std::uint32_t>();
+      auto device = r.str(dev_len);
+      auto channel = r.str(chan_len);
+      auto attr = r.str(attr_len);
+
+      attrs_[recording::attr_key(device, channel, output, attr)].emplace_back(
+          entry.timestamp_ns, r.str(val_len));
+      break;
+    }
+    case recording::RecordType::NONE:
+    case recording::RecordType::PAD:
+      break;
+  }
+}
+
+}  // namespace iio
+
+}  // namespace fsatutils
@@ -0,0 +1,330 @@
+#include <iio.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fsatutils/errors.hpp>
+#include <fsatutils/iio/sampler.hpp>
+#include <fsatutils/log/log.hpp>
+#include <map>
+#include <nlohmann/json.hpp>
+
+namespace fsatutils {
+
+namespace iio {
+
+namespace {
+
+using AttrValues = std::vector<std::pair<std::string, std::string>>;
+
+std::uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+std::uint64_t wall_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace
+
+Sampler::Sampler(std::chrono::milliseconds tick, std::size_t slots)
+    : tick_ns_{static_cast<std::uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(tick).count())},
+      wheel_(std::max<std::size_t>(slots, 1U)) {
+  if (tick_ns_ == 0) {
+    throw_runtime_error("Sampler tick must be at least 1ms!");
+  }
+}
+
+Sampler::~Sampler() { stop(); }
+
+std::size_t Sampler::add(Channel ch, std::string attr,
+                         std::chrono::milliseconds period, Callback cb) {
+  return insert({
+      .channel = std::move(ch),
+      .attr = std::move(attr),
+      .period_ns = static_cast<std::uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(period)
+              .count()),
+      .due_ns = 0,
+      .cb = std::move(cb),
+      .topic = {},
+  });
+}
+
+std::size_t Sampler::add(Channel ch, std::string attr,
+                         std::chrono::milliseconds period, std::string topic) {
+  return insert({
+      .channel = std::move(ch),
+      .attr = std::move(attr),
+      .period_ns = static_cast<std::uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(period)
+              .count()),
+      .due_ns = 0,
+      .cb = nullptr,
+      .topic = std::move(topic),
+  });
+}
+
+bool Sampler::remove(std::size_t id) {
+  std::lock_guard<std::mutex> guard{mtx_};
+
+  /* The wheel forgets the ID the next time its slot comes up */
+  return entries_.erase(id) > 0U;
+}
+
+void Sampler::set_publisher(Publisher pub) {
+  std::lock_guard<std::mutex> guard{mtx_};
+  publisher_ = std::move(pub);
+}
+
+void Sampler::start() {
+  std::lock_guard<std::mutex> guard{mtx_};
+
+  if (work_thread_.joinable()) return;
+
+  epoch_ns_ = now_ns();
+
+  for (auto& slot : wheel_) slot.clear();
+
+  for (auto& [id, e] : entries_) {
+    e.due_ns = epoch_ns_;
+    schedule(id);
+  }
+
+  work_thread_ =
+      std::jthread{[this](std::stop_token stoken) { this->workTask(stoken); }};
+}
+
+void Sampler::stop() {
+  work_thread_.request_stop();
+
+  if (work_thread_.joinable()) {
+    work_thread_.join();
+  }
+
+  work_thread_ = {};
+}
+
+Sampler::Stats Sampler::stats() const {
+  std::lock_guard<std::mutex> guard{mtx_};
+  Stats s = stats_;
+
+  s.mean_jitter_ns = (s.reads != 0U) ? static_cast<double>(jitter_sum_ns_) /
+                                           static_cast<double>(s.reads)
+                                     : 0.0;
+
+  return s;
+}
+
+std::size_t Sampler::insert(Entry entry) {
+  if (entry.period_ns < tick_ns_) {
+    throw_runtime_error("Sampling period of " + entry.attr +
+                        " is shorter than the sampler tick!");
+  }
+
+  std::lock_guard<std::mutex> guard{mtx_};
+  std::size_t id = next_id_++;
+  Entry& e = entries_.emplace(id, std::move(entry)).first->second;
+
+  if (work_thread_.joinable()) {
+    e.due_ns = now_ns();
+    schedule(id);
+  }
+
+  return id;
+}
+
+void Sampler::schedule(std::size_t id) {
+  std::uint64_t due = entries_.at(id).due_ns;
+  std::uint64_t tick =
+      (due > epoch_ns_) ? (due - epoch_ns_ + tick_ns_ - 1U) / tick_ns_ : 0U;
+
+  wheel_[tick % wheel_.size()].push_back(id);
+}
+
+void Sampler::workTask(std::stop_token stoken) {
+  std::uint64_t next_tick = 0;
+
+  while (!stoken.stop_requested()) {
+    auto target = std::chrono::steady_clock::time_point{
+        std::chrono::nanoseconds{epoch_ns_ + next_tick * tick_ns_}};
+
+    std::this_thread::sleep_until(target);
+
+    std::uint64_t current = (now_ns() - epoch_ns_) / tick_ns_;
+
+    /* When running late there is no point in visiting a slot twice */
+    std::uint64_t first =
+        std::max(next_tick, (current + 1U > wheel_.size())
+                                ? current + 1U - wheel_.size()
+                                : 0U);
+
+    std::vector<Delivery> deliveries;
+    Publisher publisher;
+
+    {
+      std::lock_guard<std::mutex> guard{mtx_};
+
+      for (std::uint64_t t = first; t <= current; t++) runTick(t);
+
+      deliveries.swap(pending_);
+      publisher = publisher_;
+    }
+
+    for (auto& d : deliveries) deliver(d, publisher);
+
+    next_tick = current + 1U;
+  }
+}
+
+void Sampler::runTick(std::uint64_t tick) {
+  auto& slot = wheel_[tick % wheel_.size()];
+  std::uint64_t now = now_ns();
+  std::vector<std::size_t> due;
+  std::size_t kept = 0;
+
+  for (std::size_t id : slot) {
+    auto it = entries_.find(id);
+
+    if (it == entries_.end()) continue;
+
+    if (it->second.due_ns <= now) {
+      due.push_back(id);
+    } else {
+      slot[kept++] = id;
+    }
+  }
+
+  slot.resize(kept);
+
+  if (due.empty()) return;
+
+  readBatch(due);
+
+  for (std::size_t id : due) {
+    auto& e = entries_.at(id);
+    std::uint64_t next = e.due_ns + e.period_ns;
+    std::uint64_t after = now_ns();
+
+    /* Keep the schedule anchored to the original phase instead of drifting */
+    if (next <= after) {
+      std::uint64_t missed = (after - next) / e.period_ns + 1U;
+      stats_.missed_deadlines += missed;
+      next += missed * e.period_ns;
+    }
+
+    e.due_ns = next;
+    schedule(id);
+  }
+}
+
+void Sampler::readBatch(std::vector<std::size_t> const& ids) {
+  std::map<const struct iio_device*,
+           std::map<struct iio_channel*, std::vector<std::size_t>>>
+      groups;
+
+  for (std::size_t id : ids) {
+    struct iio_channel* ch = entries_.at(id).channel;
+    groups[iio_channel_get_device(ch)][ch].push_back(id);
+  }
+
+  for (auto& [dev, channels] : groups) {
+    stats_.batches++;
+
+    for (auto& [ch, chan_ids] : channels) {
+      std::uint64_t ts = now_ns();
+      std::uint64_t wall = wall_ns();
+      AttrValues values;
+
+      if (chan_ids.size() > 1U) {
+        auto cb = [](struct iio_channel*, const char* attr, const char* val,
+                     std::size_t len, void* d) -> int {
+          static_cast<AttrValues*>(d)->emplace_back(
+              attr, std::string{val, strnlen(val, len)});
+          return 0;
+        };
+
+        if (iio_channel_attr_read_all(ch, cb, &values) < 0) values.clear();
+      }
+
+      for (std::size_t id : chan_ids) {
+        auto& e = entries_.at(id);
+        auto it = std::find_if(values.begin(), values.end(), [&e](auto& v) {
+          return v.first == e.attr;
+        });
+
+        if (it != values.end()) {
+          collect(e, std::move(it->second), ts, wall);
+          continue;
+        }
+
+        try {
+          collect(e, e.channel.read_attr<std::string>(e.attr), ts, wall);
+        } catch (const std::exception& ex) {
+          stats_.failures++;
+          logs::log(ERR, "Failed to sample %s of channel %s: %s\n",
+                    e.attr.c_str(), e.channel.name().c_str(), ex.what());
+        }
+      }
+    }
+  }
+}
+
+void Sampler::collect(Entry& e, std::string value, std::uint64_t ts,
+                      std::uint64_t wall) {
+  std::uint64_t jitter = (ts > e.due_ns) ? ts - e.due_ns : 0U;
+
+  stats_.reads++;
+  stats_.max_jitter_ns = std::max(stats_.max_jitter_ns, jitter);
+  jitter_sum_ns_ += jitter;
+
+  if (!e.cb && e.topic.empty()) return;
+
+  Sample s{
+      .device = iio_device_get_id(iio_channel_get_device(e.channel)),
+      .channel = e.channel.id(),
+      .attr = e.attr,
+      .value = std::move(value),
+      .scheduled_ns = e.due_ns,
+      .timestamp_ns = ts,
+      .wall_ns = wall,
+  };
+
+  pending_.push_back({.sample = std::move(s), .cb = e.cb, .topic = e.topic});
+}
+
+void Sampler::deliver(Delivery& d, Publisher const& publisher) {
+  Sample const& s = d.sample;
+
+  if (d.cb) {
+    d.cb(s);
+    return;
+  }
+
+  if (!publisher) return;
+
+  nlohmann::json j;
+
+  j["device"] = s.device;
+  j["channel"] = s.channel;
+  j["attr"] = s.attr;
+  j["value"] = s.value;
+  j["timestamp"] = s.timestamp_ns;
+
+  std::string payload = j.dump();
+  std::span<std::uint8_t> data{reinterpret_cast<std::uint8_t*>(payload.data()),
+                               payload.size()};
+
+  if (!publisher(d.topic, data)) {
+    logs::log(ERR, "Failed to publish sample on topic [%s]\n",
+              d.topic.c_str());
+  }
+}
+
+}  // namespace iio
+
+}  // namespace fsatutils
@@ -0,0 +1,679 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <fsatutils/errors.hpp>
+#include <fsatutils/log/binlog.hpp>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+namespace bl = logs::binlog;
+
+constexpr std::size_t RING_SIZE = 256U << 10U;
+
+/* Single producer (the owning thread), single consumer (the writer) */
+class ThreadRing {
+ public:
+  /* Returns the number of bytes pending after the push */
+  std::size_t push(std::span<const std::uint8_t> entry) {
+    auto len = static_cast<std::uint32_t>(entry.size());
+    std::size_t head = head_.load(std::memory_order_relaxed);
+    std::size_t tail = tail_.load(std::memory_order_acquire);
+
+    if (RING_SIZE - (head - tail) < sizeof(len) + len) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return head - tail;
+    }
+
+    copy_in(head, &len, sizeof(len));
+    copy_in(head + sizeof(len), entry.data(), len);
+    head += sizeof(len) + len;
+    head_.store(head, std::memory_order_release);
+
+    return head - tail;
+  }
+
+  /* Appends pending entries to out, each prefixed by its length */
+  void drain(std::vector<std::uint8_t>& out) {
+    std::size_t tail = tail_.load(std::memory_order_relaxed);
+    std::size_t head = head_.load(std::memory_order_acquire);
+    std::size_t off = out.size();
+
+    out.resize(off + (head - tail));
+    copy_out(tail, out.data() + off, head - tail);
+    tail_.store(head, std::memory_order_release);
+  }
+
+  std::uint64_t take_dropped() {
+    return dropped_.exchange(0, std::memory_order_relaxed);
+  }
+
+  std::atomic<bool> retired = false;
+
+ private:
+  void copy_in(std::size_t pos, const void* src, std::size_t len) {
+    std::size_t off = pos & (RING_SIZE - 1U);
+    std::size_t first = std::min(len, RING_SIZE - off);
+
+    std::memcpy(data_.get() + off, src, first);
+    std::memcpy(data_.get(), static_cast<const std::uint8_t*>(src) + first,
+                len - first);
+  }
+
+  void copy_out(std::size_t pos, std::uint8_t* dst, std::size_t len) {
+    std::size_t off = pos & (RING_SIZE - 1U);
+    std::size_t first = std::min(len, RING_SIZE - off);
+
+    std::memcpy(dst, data_.get() + off, first);
+    std::memcpy(dst + first, data_.get(), len - first);
+  }
+
+  std::unique_ptr<std::uint8_t[]> data_ =
+      std::make_unique<std::uint8_t[]>(RING_SIZE);
+  alignas(64) std::atomic<std::size_t> head_ = 0;
+  alignas(64) std::atomic<std::size_t> tail_ = 0;
+  alignas(64) std::atomic<std::uint64_t> dropped_ = 0;
+};
+
+std::uint64_t read_u64(const std::uint8_t* p) {
+  std::uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+std::uint32_t read_u32(const std::uint8_t* p) {
+  std::uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+void write_all(int fd, const void* data, std::size_t len) {
+  auto p = static_cast<const char*>(data);
+
+  while (len > 0) {
+    ssize_t res = ::write(fd, p, len);
+
+    if (res < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+
+    p += res;
+    len -= static_cast<std::size_t>(res);
+  }
+}
+
+template <typename T>
+void put(std::vector<std::uint8_t>& out, T const& value) {
+  auto p = reinterpret_cast<const std::uint8_t*>(&value);
+  out.insert(out.end(), p, p + sizeof(T));
+}
+
+void put_record(std::vector<std::uint8_t>& out, bl::RecordType type,
+                std::span<const std::uint8_t> payload) {
+  put(out, bl::RecordHeader{type, 0, 0,
+                            static_cast<std::uint32_t>(payload.size())});
+  out.insert(out.end(), payload.begin(), payload.end());
+}
+
+class Writer {
+ public:
+  std::uint32_t register_site(bl::Site& site, const char* signature) {
+    /* Without an explicit start() entries are formatted in the background */
+    if (!started_.load(std::memory_order_acquire)) start("");
+
+    std::lock_guard<std::mutex> lock{mtx_};
+    std::uint32_t id = site.id.load(std::memory_order_relaxed);
+
+    if (id != bl::UNREGISTERED) return id;
+
+    id = static_cast<std::uint32_t>(sites_.size());
+    site.signature = signature;
+    sites_.push_back(&site);
+    site.id.store(id, std::memory_order_release);
+
+    return id;
+  }
+
+  ThreadRing& local() {
+    struct Local {
+      Local() : ring{std::make_shared<ThreadRing>()} {
+        Writer::instance().attach(ring);
+      }
+      ~Local() { ring->retired.store(true, std::memory_order_release); }
+
+      std::shared_ptr<ThreadRing> ring;
+    };
+
+    thread_local Local local;
+
+    return *local.ring;
+  }
+
+  void start(std::string const& path) {
+    std::lock_guard<std::mutex> lock{control_mtx_};
+
+    if (path.empty() && started_.load(std::memory_order_relaxed)) return;
+
+    stop_locked();
+    open(path);
+
+    if (!started_.exchange(true, std::memory_order_release)) {
+      std::atexit([] { logs::binlog::stop(); });
+    }
+
+    thread_ = std::jthread{[this](std::stop_token st) { workTask(st); }};
+  }
+
+  void stop() {
+    std::lock_guard<std::mutex> lock{control_mtx_};
+    stop_locked();
+  }
+
+  void drain() {
+    std::lock_guard<std::mutex> lock{drain_mtx_};
+    std::vector<std::shared_ptr<ThreadRing>> rings;
+    std::size_t nsites;
+
+    {
+      std::lock_guard<std::mutex> guard{mtx_};
+      rings = rings_;
+    }
+
+    /* A ring is only released if its thread had exited before the drain,
+     * so nothing it wrote on the way out is lost */
+    std::vector<ThreadRing*> retired;
+
+    raw_.clear();
+    for (auto& ring : rings) {
+      if (ring->retired.load(std::memory_order_acquire)) {
+        retired.push_back(ring.get());
+      }
+
+      ring->drain(raw_);
+      dropped_ += ring->take_dropped();
+    }
+
+    {
+      std::lock_guard<std::mutex> guard{mtx_};
+
+      /* Taken after the rings, so every entry drained has its site written
+       * first; sites registered since go out with the next batch */
+      nsites = sites_.size();
+
+      std::erase_if(rings_, [&retired](auto const& ring) {
+        return std::find(retired.begin(), retired.end(), ring.get()) !=
+               retired.end();
+      });
+    }
+
+    /* Rings are drained one after the other; restore the time order of the
+     * batch before writing it */
+    entries_.clear();
+    for (std::size_t off = 0; off < raw_.size();) {
+      std::uint32_t len = read_u32(raw_.data() + off);
+
+      entries_.push_back({raw_.data() + off + 4U, len});
+      off += 4U + len;
+    }
+
+    std::stable_sort(entries_.begin(), entries_.end(), [](auto a, auto b) {
+      return read_u64(a.data() + 4U) < read_u64(b.data() + 4U);
+    });
+
+    if (fd_ >= 0) {
+      write_binary(nsites);
+    } else {
+      write_text();
+    }
+
+    dropped_ = 0;
+  }
+
+  void wake() {
+    if (!wake_.exchange(true, std::memory_order_acq_rel)) cv_.notify_one();
+  }
+
+  static Writer& instance() {
+    /* Never destroyed, threads may still log while statics are torn down */
+    static Writer* writer = new Writer{};
+    return *writer;
+  }
+
+ private:
+  void attach(std::shared_ptr<ThreadRing> ring) {
+    std::lock_guard<std::mutex> lock{mtx_};
+    rings_.push_back(std::move(ring));
+  }
+
+  void open(std::string const& path) {
+    if (path.empty()) return;
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+
+    if (fd < 0) {
+      logs::log(ERR, "Failed to open binary log %s: %s\n", path.c_str(),
+                std::strerror(errno));
+      return;
+    }
+
+    bl::FileHeader header = {};
+
+    std::memcpy(header.magic, bl::MAGIC, sizeof(header.magic));
+    header.version = bl::VERSION;
+    header.steady_start_ns = static_cast<std::uint64_t>(
+        std::chrono::steady_clock::now().time_since_epoch().count());
+    header.realtime_start_ns = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count());
+
+    write_all(fd, &header, sizeof(header));
+
+    std::lock_guard<std::mutex> lock{drain_mtx_};
+    fd_ = fd;
+    emitted_sites_ = 0;
+  }
+
+  void stop_locked() {
+    if (thread_.joinable()) {
+      thread_.request_stop();
+      thread_.join();
+    }
+
+    std::lock_guard<std::mutex> lock{drain_mtx_};
+
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  void workTask(std::stop_token stoken) {
+    std::mutex mtx;
+    std::unique_lock<std::mutex> lock{mtx};
+
+    while (!stoken.stop_requested()) {
+      cv_.wait_for(lock, stoken, logs::flushInterval, [this] {
+        return wake_.exchange(false, std::memory_order_acq_rel);
+      });
+      drain();
+    }
+
+    drain();
+  }
+
+  void write_binary(std::size_t nsites) {
+    out_.clear();
+
+    for (; emitted_sites_ < nsites; emitted_sites_++) {
+      bl::Site* site;
+
+      {
+        std::lock_guard<std::mutex> guard{mtx_};
+        site = sites_[emitted_sites_];
+      }
+
+      std::string_view fmt{site->fmt};
+      std::string_view file{site->file};
+      std::string_view sig{site->signature};
+      std::vector<std::uint8_t> payload;
+
+      put(payload, static_cast<std::uint32_t>(emitted_sites_));
+      put(payload, static_cast<std::int32_t>(site->level));
+      put(payload, static_cast<std::int32_t>(site->line));
+      put(payload, static_cast<std::uint32_t>(fmt.size()));
+      put(payload, static_cast<std::uint32_t>(file.size()));
+      put(payload, static_cast<std::uint32_t>(sig.size()));
+      payload.insert(payload.end(), fmt.begin(), fmt.end());
+      payload.insert(payload.end(), file.begin(), file.end());
+      payload.insert(payload.end(), sig.begin(), sig.end());
+
+      put_record(out_, bl::RecordType::SITE, payload);
+    }
+
+    for (auto entry : entries_) put_record(out_, bl::RecordType::ENTRY, entry);
+
+    if (dropped_ > 0) {
+      std::uint8_t payload[sizeof(dropped_)];
+
+      std::memcpy(payload, &dropped_, sizeof(dropped_));
+      put_record(out_, bl::RecordType::DROPPED, payload);
+    }
+
+    if (!out_.empty()) write_all(fd_, out_.data(), out_.size());
+  }
+
+  void write_text() {
+    for (auto entry : entries_) {
+      bl::Site* site;
+
+      {
+        std::lock_guard<std::mutex> guard{mtx_};
+        site = sites_[read_u32(entry.data())];
+      }
+
+      logs::log(site->level,
+                bl::format(site->fmt, site->signature, entry.subspan(12U)));
+    }
+
+    if (dropped_ > 0) {
+      logs::log(WARN, "%llu binary log entries dropped",
+                static_cast<unsigned long long>(dropped_));
+    }
+  }
+
+  std::mutex control_mtx_;
+  std::atomic<bool> started_ = false;
+  std::mutex mtx_;
+  std::vector<bl::Site*> sites_;
+  std::vector<std::shared_ptr<ThreadRing>> rings_;
+
+  /* Writer state, guarded by drain_mtx_ */
+  std::mutex drain_mtx_;
+  int fd_ = -1;
+  std::size_t emitted_sites_ = 0;
+  std::uint64_t dropped_ = 0;
+  std::vector<std::uint8_t> raw_;
+  std::vector<std::uint8_t> out_;
+  std::vector<std::span<const std::uint8_t>> entries_;
+
+  std::atomic<bool> wake_ = false;
+  std::condition_variable_any cv_;
+  std::jthread thread_;
+};
+
+struct Value {
+  char tag = '\0';
+  std::int64_t i = 0;
+  std::uint64_t u = 0;
+  double d = 0.0;
+  std::string s;
+};
+
+bool next_value(std::string_view sig, std::size_t& n,
+                std::span<const std::uint8_t> args, std::size_t& off,
+                Value& v) {
+  if (n >= sig.size()) return false;
+
+  v.tag = sig[n++];
+
+  if (v.tag == 's') {
+    std::uint16_t len;
+
+    if (off + sizeof(len) > args.size()) return false;
+    std::memcpy(&len, args.data() + off, sizeof(len));
+    off += sizeof(len);
+
+    if (off + len > args.size()) return false;
+    v.s.assign(reinterpret_cast<const char*>(args.data()) + off, len);
+    off += len;
+
+    return true;
+  }
+
+  if (off + 8U > args.size()) return false;
+
+  v.u = read_u64(args.data() + off);
+  std::memcpy(&v.i, &v.u, sizeof(v.i));
+  std::memcpy(&v.d, &v.u, sizeof(v.d));
+  off += 8U;
+
+  if (v.tag == 'i') {
+    v.d = static_cast<double>(v.i);
+  } else if (v.tag == 'u' || v.tag == 'p') {
+    v.i = static_cast<std::int64_t>(v.u);
+    v.d = static_cast<double>(v.u);
+  } else if (v.tag == 'd') {
+    double d = v.d;
+    v.i = static_cast<std::int64_t>(d);
+    v.u = static_cast<std::uint64_t>(v.i);
+  }
+
+  return true;
+}
+
+template <typename T>
+void append(std::string& out, std::string const& spec, T value) {
+  char buf[128];
+  int n = std::snprintf(buf, sizeof(buf), spec.c_str(), value);
+
+  if (n < 0) return;
+
+  if (static_cast<std::size_t>(n) < sizeof(buf)) {
+    out.append(buf, static_cast<std::size_t>(n));
+    return;
+  }
+
+  std::size_t off = out.size();
+
+  out.resize(off + static_cast<std::size_t>(n) + 1U);
+  std::snprintf(out.data() + off, static_cast<std::size_t>(n) + 1U,
+                spec.c_str(), value);
+  out.resize(off + static_cast<std::size_t>(n));
+}
+
+}  // namespace
+
+std::uint32_t logs::binlog::register_site(Site& site, const char* signature) {
+  return Writer::instance().register_site(site, signature);
+}
+
+void logs::binlog::push(std::span<const std::uint8_t> entry) {
+  Writer& writer = Writer::instance();
+
+  if (writer.local().push(entry) > RING_SIZE / 2U) writer.wake();
+}
+
+void logs::binlog::start(std::string const& path) {
+  Writer::instance().start(path);
+}
+
+void logs::binlog::flush() {
+  Writer::instance().drain();
+  logs::flush();
+}
+
+void logs::binlog::stop() { Writer::instance().stop(); }
+
+/* printf-style formatting of recorded arguments. Length modifiers in the
+ * format are ignored, values are passed with the width they were recorded
+ * with, converting between numbers and strings where the types disagree. */
+std::string logs::binlog::format(std::string_view fmt,
+                                 std::string_view signature,
+                                 std::span<const std::uint8_t> args) {
+  std::string out;
+  std::size_t n = 0;
+  std::size_t off = 0;
+  Value v;
+
+  out.reserve(fmt.size() + 32U);
+
+  for (std::size_t i = 0; i < fmt.size(); i++) {
+    if (fmt[i] != '%') {
+      out += fmt[i];
+      continue;
+    }
+
+    if (i + 1U < fmt.size() && fmt[i + 1U] == '%') {
+      out += '%';
+      i++;
+      continue;
+    }
+
+    std::size_t start = i;
+    std::string spec = "%";
+
+    for (i++; i < fmt.size(); i++) {
+      char c = fmt[i];
+
+      if (c == '*') {
+        if (next_value(signature, n, args, off, v)) spec += std::to_string(v.i);
+      } else if (std::string_view{"-+ #0123456789."}.find(c) !=
+                 std::string_view::npos) {
+        spec += c;
+      } else if (std::string_view{"hlLqjzt"}.find(c) ==
+                 std::string_view::npos) {
+        break;
+      }
+    }
+
+    if (i >= fmt.size()) {
+      out.append(fmt.substr(start));
+      break;
+    }
+
+    char conv = fmt[i];
+
+    if (!next_value(signature, n, args, off, v)) {
+      out.append(fmt.substr(start, i - start + 1U));
+      continue;
+    }
+
+    switch (conv) {
+      case 'd':
+      case 'i':
+        append(out, spec + "lld", static_cast<long long>(v.i));
+        break;
+      case 'u':
+      case 'x':
+      case 'X':
+      case 'o':
+        append(out, spec + "ll" + conv, static_cast<unsigned long long>(v.u));
+        break;
+      case 'c':
+        append(out, spec + 'c', static_cast<int>(v.i));
+        break;
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A':
+        append(out, spec + conv, v.d);
+        break;
+      case 'p':
+        append(out, spec + 'p',
+               reinterpret_cast<void*>(static_cast<std::uintptr_t>(v.u)));
+        break;
+      case 's':
+        if (v.tag != 's') {
+          v.s = v.tag == 'd'   ? std::to_string(v.d)
+                : v.tag == 'i' ? std::to_string(v.i)
+                               : std::to_string(v.u);
+        }
+        append(out, spec + 's', v.s.c_str());
+        break;
+      default:
+        out.append(fmt.substr(start, i - start + 1U));
+        break;
+    }
+  }
+
+  return out;
+}
+
+logs::binlog::Decoder::Decoder(std::string const& path) {
+  std::ifstream file{path, std::ios::binary};
+
+  if (!file) throw_runtime_error("Failed to open binary log " + path);
+
+  std::ostringstream ss;
+
+  ss << file.rdbuf();
+  data_ = ss.str();
+
+  FileHeader header;
+
+  if (data_.size() < sizeof(header)) {
+    throw_runtime_error(path + " is not a binary log");
+  }
+
+  std::memcpy(&header, data_.data(), sizeof(header));
+
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+    throw_runtime_error(path + " is not a binary log");
+  }
+
+  if (header.version != VERSION) {
+    throw_runtime_error("Unsupported binary log version " +
+                        std::to_string(header.version));
+  }
+
+  clock_offset_ = static_cast<std::int64_t>(header.realtime_start_ns -
+                                            header.steady_start_ns);
+  pos_ = sizeof(header);
+}
+
+bool logs::binlog::Decoder::next(Message& msg) {
+  while (pos_ + sizeof(RecordHeader) <= data_.size()) {
+    RecordHeader rec;
+
+    std::memcpy(&rec, data_.data() + pos_, sizeof(rec));
+
+    /* A truncated tail (e.g. after a crash) ends the log */
+    if (pos_ + sizeof(rec) + rec.size > data_.size()) break;
+
+    auto p = reinterpret_cast<const std::uint8_t*>(data_.data()) + pos_ +
+             sizeof(rec);
+    std::span<const std::uint8_t> payload{p, rec.size};
+
+    pos_ += sizeof(rec) + rec.size;
+
+    if (rec.type == RecordType::SITE && rec.size >= 24U) {
+      std::uint32_t id = read_u32(p);
+      std::uint32_t fmt_len = read_u32(p + 12U);
+      std::uint32_t file_len = read_u32(p + 16U);
+      std::uint32_t sig_len = read_u32(p + 20U);
+      auto text = reinterpret_cast<const char*>(p + 24U);
+
+      if (24U + std::size_t{fmt_len} + file_len + sig_len > rec.size) continue;
+
+      if (id >= sites_.size()) sites_.resize(id + 1U);
+
+      sites_[id] = {static_cast<LogLevel>(static_cast<std::int32_t>(
+                        read_u32(p + 4U))),
+                    static_cast<int>(read_u32(p + 8U)),
+                    std::string{text, fmt_len},
+                    std::string{text + fmt_len, file_len},
+                    std::string{text + fmt_len + file_len, sig_len}};
+    } else if (rec.type == RecordType::DROPPED && rec.size >= 8U) {
+      std::uint64_t count = read_u64(p);
+
+      dropped_ += count;
+      msg = {WARN, last_ns_, {}, 0,
+             std::to_string(count) + " binary log entries dropped"};
+
+      return true;
+    } else if (rec.type == RecordType::ENTRY && rec.size >= 12U) {
+      std::uint32_t id = read_u32(p);
+
+      if (id >= sites_.size()) continue;
+
+      SiteInfo const& site = sites_[id];
+
+      msg.level = site.level;
+      msg.timestamp_ns =
+          read_u64(p + 4U) + static_cast<std::uint64_t>(clock_offset_);
+      last_ns_ = msg.timestamp_ns;
+      msg.file = site.file;
+      msg.line = site.line;
+      msg.text = format(site.fmt, site.signature, payload.subspan(12U));
+
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -1,53 +1,998 @@
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef FSATUTILS_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 #include <filesystem>
-#include <fstream>
-#include <iostream>
 #include <fsatutils/log/log.hpp>
+#include <memory>
+#include <thread>
+#include <vector>
 
-void logs::init(std::string log_dir) {
-  logFile = log_dir + "/fsat-sens.log";
+namespace {
 
-  if (!std::filesystem::exists(log_dir))
-    std::filesystem::create_directories(log_dir);
+namespace fs = std::filesystem;
+
+/* Messages longer than a slot bypass the ring (see write_long) */
+constexpr std::size_t SLOT_TEXT = 480U;
+constexpr std::size_t BATCH_SIZE = 64U << 10U;
+constexpr std::size_t MAX_SINKS = 32U;
+constexpr int CRASH_SPIN = 100000;
+constexpr int FULL_RETRIES = 64;
+constexpr std::chrono::seconds MAINTENANCE_INTERVAL{60};
+constexpr const char* DEFAULT_SERVICE = "fsat-sens";
+
+struct Slot {
+  std::atomic<std::size_t> seq;
+  LogLevel level;
+  std::uint16_t sink;
+  std::uint32_t len;
+  char text[SLOT_TEXT];
+};
+
+/* Bounded MPSC queue: producers claim a slot with a CAS on head_ and publish
+ * it through the slot sequence, so pushing never takes a lock. */
+class Ring {
+ public:
+  explicit Ring(std::size_t slots) {
+    std::size_t n = 64U;
+
+    while (n < slots) n <<= 1U;
+
+    slots_ = std::make_unique<Slot[]>(n);
+    mask_ = n - 1U;
+
+    for (std::size_t i = 0; i < n; i++) {
+      slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool push(LogLevel level, std::uint16_t sink, std::string_view text) {
+    std::size_t pos = head_.load(std::memory_order_relaxed);
+    Slot* slot;
+
+    while (true) {
+      slot = &slots_[pos & mask_];
+
+      std::size_t seq = slot->seq.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1U,
+                                        std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+
+    slot->level = level;
+    slot->sink = sink;
+    slot->len = static_cast<std::uint32_t>(text.size());
+    std::memcpy(slot->text, text.data(), text.size());
+    slot->seq.store(pos + 1U, std::memory_order_release);
+
+    return true;
+  }
+
+  /* Consumer side, only called by whoever holds the drain flag */
+  Slot* front() {
+    std::size_t tail = tail_.load(std::memory_order_relaxed);
+    Slot* slot = &slots_[tail & mask_];
+
+    if (slot->seq.load(std::memory_order_acquire) != tail + 1U) {
+      return nullptr;
+    }
+
+    return slot;
+  }
+
+  void pop() {
+    std::size_t tail = tail_.load(std::memory_order_relaxed);
+
+    slots_[tail & mask_].seq.store(tail + mask_ + 1U,
+                                   std::memory_order_release);
+    tail_.store(tail + 1U, std::memory_order_relaxed);
+  }
+
+  std::size_t pending() const {
+    return head_.load(std::memory_order_relaxed) -
+           tail_.load(std::memory_order_relaxed);
+  }
+
+  std::size_t capacity() const { return mask_ + 1U; }
+
+ private:
+  std::unique_ptr<Slot[]> slots_;
+  std::size_t mask_;
+  alignas(64) std::atomic<std::size_t> head_ = 0;
+  alignas(64) std::atomic<std::size_t> tail_ = 0;
+};
+
+void write_all(int fd, const char* data, std::size_t len) {
+  while (len > 0) {
+    ssize_t res = ::write(fd, data, len);
+
+    if (res < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+
+    data += res;
+    len -= static_cast<std::size_t>(res);
+  }
 }
 
-void logs::log(const LogLevel level, std::string str) {
-  std::lock_guard<std::recursive_mutex> guard{logMutex};
-  std::string coloredStr = str;
-  std::string out = str;
+/* Fixed-size output buffer; no allocation so it is usable from the crash
+ * handler */
+class Batch {
+ public:
+  void put(int fd, std::string_view s) {
+    if (len_ + s.size() > sizeof(data_)) flush(fd);
 
-  if (level < logs::global_log_level) return;
+    if (s.size() > sizeof(data_)) {
+      write_all(fd, s.data(), s.size());
+      return;
+    }
+
+    std::memcpy(data_ + len_, s.data(), s.size());
+    len_ += s.size();
+  }
 
+  void flush(int fd) {
+    if (len_ > 0 && fd >= 0) write_all(fd, data_, len_);
+    len_ = 0;
+  }
+
+ private:
+  char data_[BATCH_SIZE];
+  std::size_t len_ = 0;
+};
+
+/* A log file; everything but the name and rotation is only touched by the
+ * holder of the drain flag */
+struct Sink {
+  std::string component;
+  logs::Rotation rotation;
+  std::string stem;
+  int fd = -1;
+  std::uint64_t size = 0;
+  std::chrono::system_clock::time_point opened;
+  bool dirty = false;
+  bool sync = false;
+  Batch batch;
+  /* Last line written, for collapsing repeats */
+  LogLevel last_level = NONE;
+  std::uint32_t last_len = 0;
+  char last[SLOT_TEXT];
+  std::uint64_t repeats = 0;
+  std::chrono::system_clock::time_point repeat_since;
+};
+
+/* Rotated files are <stem>.<timestamp>.log[.gz]; returns the timestamp */
+std::string_view rotated_stamp(std::string_view name, std::string_view stem) {
+  if (name.size() <= stem.size() + 1U || !name.starts_with(stem) ||
+      name[stem.size()] != '.') {
+    return {};
+  }
+
+  name.remove_prefix(stem.size() + 1U);
+
+  for (std::string_view ext : {".log", ".log.gz"}) {
+    if (name.size() > ext.size() && name.ends_with(ext) &&
+        name.find('.') == name.size() - ext.size()) {
+      return name.substr(0, name.size() - ext.size());
+    }
+  }
+
+  return {};
+}
+
+/* Without zlib rotated files are kept uncompressed */
+bool compress([[maybe_unused]] fs::path const& path,
+              [[maybe_unused]] std::stop_token const& stoken) {
+#ifdef FSATUTILS_HAVE_ZLIB
+  fs::path gz = path.string() + ".gz";
+  fs::path tmp = path.string() + ".gz.tmp";
+  int in = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (in < 0) return false;
+
+  gzFile out = gzopen(tmp.c_str(), "wb6");
+
+  if (out == nullptr) {
+    ::close(in);
+    return false;
+  }
+
+  std::vector<char> buf(BATCH_SIZE);
+  bool ok = true;
+  ssize_t n;
+
+  while (ok && (n = ::read(in, buf.data(), buf.size())) != 0) {
+    if (n < 0) {
+      ok = errno == EINTR;
+      continue;
+    }
+
+    ok = !stoken.stop_requested() &&
+         gzwrite(out, buf.data(), static_cast<unsigned>(n)) == n;
+  }
+
+  ::close(in);
+  ok = gzclose(out) == Z_OK && ok;
+
+  std::error_code ec;
+
+  if (!ok) {
+    fs::remove(tmp, ec);
+    return false;
+  }
+
+  fs::rename(tmp, gz, ec);
+  if (!ec) fs::remove(path, ec);
+
+  return !ec;
+#else
+  return false;
+#endif
+}
+
+std::string_view prefix(LogLevel level) {
   switch (level) {
     case LOG:
-      out = "[LOG] " + str;
-      coloredStr = str;
-      break;
+      return "[LOG] ";
     case WARN:
-      out = "[WARN] " + str;
-      coloredStr = "\033[1;33m" + str + "\033[0m";  // yellow
-      break;
+      return "[WARN] ";
     case ERR:
-      out = "[ERR] " + str;
-      coloredStr = "\033[1;31m" + str + "\033[0m";  // red
-      break;
+      return "[ERR] ";
     case INFO:
-      out = "[INFO] " + str;
-      coloredStr = "\033[1;32m" + str + "\033[0m";  // green
-      break;
+      return "[INFO] ";
     case DEBUG:
-      out = "[DEBUG] " + str;
-      coloredStr = "\033[1;34m" + str + "\033[0m";  // blue
-      break;
+      return "[DEBUG] ";
     default:
-      break;
+      return "";
   }
+}
 
-  if (!disableFileLogs && !logFile.empty()) {
-    std::ofstream ofs;
-    ofs.open(logFile, std::ios::out | std::ios::app);
-    ofs << out << "\n";
-    ofs.close();
+std::string_view color(LogLevel level) {
+  switch (level) {
+    case WARN:
+      return "\033[1;33m";  // yellow
+    case ERR:
+      return "\033[1;31m";  // red
+    case INFO:
+      return "\033[1;32m";  // green
+    case DEBUG:
+      return "\033[1;34m";  // blue
+    default:
+      return "";
   }
+}
+
+std::int64_t coarse_now_ns() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+
+  return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/* Fixed table of call sites keyed on the format string address, filled
+ * without locks; sites that do not fit are never limited */
+class Limiter {
+ public:
+  static constexpr std::size_t SITES = 1024U;
+  static constexpr std::size_t PROBES = 8U;
+
+  bool admit(LogLevel level, const char* fmt) {
+    if (level < LOG || level > ERR || fmt == nullptr) return true;
+
+    logs::RateLimit limit = logs::rateLimits[level];
+
+    if (limit.burst == 0) return true;
+
+    Site* site = find(fmt);
+
+    if (site == nullptr) return true;
+
+    std::int64_t now = coarse_now_ns();
+    std::int64_t start = site->start.load(std::memory_order_relaxed);
+    std::int64_t period = std::chrono::nanoseconds{limit.period}.count();
+
+    if (now - start >= period &&
+        site->start.compare_exchange_strong(start, now,
+                                            std::memory_order_relaxed)) {
+      site->level.store(level, std::memory_order_relaxed);
+      site->count.store(1, std::memory_order_relaxed);
+      report(*site);
+      return true;
+    }
+
+    if (site->count.fetch_add(1, std::memory_order_relaxed) < limit.burst) {
+      return true;
+    }
+
+    site->suppressed.fetch_add(1, std::memory_order_relaxed);
+
+    return false;
+  }
+
+  /* Reports sites whose period ended while they were being suppressed, or
+   * every pending count when flushing at shutdown */
+  void sweep(bool flush = false) {
+    std::int64_t now = coarse_now_ns();
+
+    for (auto& site : sites_) {
+      if (site.fmt.load(std::memory_order_acquire) == nullptr) continue;
+      if (site.suppressed.load(std::memory_order_relaxed) == 0) continue;
+
+      auto level = site.level.load(std::memory_order_relaxed);
+      std::int64_t period =
+          std::chrono::nanoseconds{logs::rateLimits[level].period}.count();
+
+      if (flush || now - site.start.load(std::memory_order_relaxed) >= period) {
+        report(site);
+      }
+    }
+  }
+
+ private:
+  struct Site {
+    std::atomic<const char*> fmt = nullptr;
+    std::atomic<std::int64_t> start = 0;
+    std::atomic<std::uint32_t> count = 0;
+    std::atomic<std::uint32_t> suppressed = 0;
+    std::atomic<LogLevel> level = LOG;
+  };
+
+  Site* find(const char* fmt) {
+    std::size_t h = std::hash<const void*>{}(fmt);
+
+    for (std::size_t i = 0; i < PROBES; i++) {
+      Site& site = sites_[(h + i) & (SITES - 1U)];
+      const char* key = site.fmt.load(std::memory_order_acquire);
+
+      if (key == fmt) return &site;
+
+      if (key == nullptr &&
+          (site.fmt.compare_exchange_strong(key, fmt,
+                                            std::memory_order_acq_rel) ||
+           key == fmt)) {
+        return &site;
+      }
+    }
+
+    return nullptr;
+  }
+
+  void report(Site& site);
+
+  std::array<Site, SITES> sites_;
+};
+
+class Backend {
+ public:
+  Backend() : ring_{logs::ringSlots} {
+    sinks_[0] = std::make_unique<Sink>();
+    sinks_[0]->rotation = logs::rotation;
+    sinks_[0]->stem = DEFAULT_SERVICE;
+    nsinks_.store(1U, std::memory_order_release);
+
+    thread_ = std::jthread{[this](std::stop_token st) { workTask(st); }};
+    maintenance_ =
+        std::jthread{[this](std::stop_token st) { maintenanceTask(st); }};
+
+    std::atexit([] { logs::shutdown(); });
+    install_crash_handlers();
+  }
+
+  void enqueue(LogLevel level, std::uint16_t sink, std::string_view text) {
+    if (text.size() > SLOT_TEXT) {
+      write_long(level, sink, text);
+      return;
+    }
+
+    /* A full ring makes the producer help draining it; messages are only
+     * dropped if that does not free a slot either */
+    for (int i = 0; !ring_.push(level, sink, text); i++) {
+      if (i == FULL_RETRIES) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        wake();
+        return;
+      }
+
+      if (!draining_.load(std::memory_order_relaxed)) drain(true);
+      sched_yield();
+    }
+
+    if (!running_.load(std::memory_order_acquire)) {
+      drain(true);
+    } else if (level >= logs::flushLevel ||
+               ring_.pending() > ring_.capacity() / 2U) {
+      wake();
+    }
+  }
+
+  /* Writes everything queued so far; returns false if another thread kept
+   * the ring busy for longer than the crash handler is willing to wait */
+  bool drain(bool wait, bool crash = false) {
+    int spins = 0;
+
+    while (draining_.exchange(true, std::memory_order_acquire)) {
+      if (!wait && ++spins > CRASH_SPIN) return false;
+      sched_yield();
+    }
+
+    now_ = crash ? std::chrono::system_clock::time_point{}
+                 : std::chrono::system_clock::now();
+
+    while (Slot* slot = ring_.front()) {
+      write_line(slot->level, slot->sink, {slot->text, slot->len}, crash);
+      ring_.pop();
+    }
+
+    std::uint64_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+
+    if (dropped > 0) {
+      char msg[64];
+      int n = std::snprintf(msg, sizeof(msg), "%llu log messages dropped",
+                            static_cast<unsigned long long>(dropped));
+      write_line(WARN, 0, {msg, static_cast<std::size_t>(n)}, crash);
+    }
+
+    finish(crash);
+    draining_.store(false, std::memory_order_release);
+
+    return true;
+  }
+
+  std::uint16_t add_sink(std::string component,
+                         logs::Rotation const& rotation) {
+    std::lock_guard<std::mutex> lock{config_mtx_};
+    std::size_t n = nsinks_.load(std::memory_order_relaxed);
+
+    for (std::size_t i = 1; i < n; i++) {
+      if (sinks_[i]->component == component) {
+        return static_cast<std::uint16_t>(i);
+      }
+    }
+
+    /* Out of sinks, share the service log */
+    if (n == MAX_SINKS) return 0;
+
+    auto sink = std::make_unique<Sink>();
+
+    sink->component = std::move(component);
+    sink->rotation = rotation;
+    sink->stem = service_ + "-" + sink->component;
+
+    lock_drain();
+
+    if (!dir_.empty()) open(*sink);
+
+    sinks_[n] = std::move(sink);
+    nsinks_.store(n + 1U, std::memory_order_release);
+    draining_.store(false, std::memory_order_release);
+
+    return static_cast<std::uint16_t>(n);
+  }
+
+  /* Switches every sink to files in dir named after service; returns false
+   * if the service log could not be opened */
+  bool configure(std::string dir, std::string service) {
+    drain(true);
+
+    std::lock_guard<std::mutex> lock{config_mtx_};
+    std::size_t n = nsinks_.load(std::memory_order_relaxed);
+
+    lock_drain();
+
+    dir_ = std::move(dir);
+    service_ = std::move(service);
+    now_ = std::chrono::system_clock::now();
+    sinks_[0]->rotation = logs::rotation;
+
+    for (std::size_t i = 0; i < n; i++) {
+      Sink& sink = *sinks_[i];
+
+      sink.stem = i == 0 ? service_ : service_ + "-" + sink.component;
+      open(sink);
+    }
+
+    bool ok = sinks_[0]->fd >= 0;
+
+    draining_.store(false, std::memory_order_release);
+    wake_maintenance();
+
+    return ok;
+  }
+
+  void stop() {
+    if (!running_.exchange(false)) return;
+
+    thread_.request_stop();
+    if (thread_.joinable()) thread_.join();
+
+    maintenance_.request_stop();
+    if (maintenance_.joinable()) maintenance_.join();
+
+    limiter_.sweep(true);
+    drain(true);
+  }
+
+  static void crash(int sig) {
+    instance().drain(false, true);
+
+    ::signal(sig, SIG_DFL);
+    ::raise(sig);
+  }
+
+  bool admit(LogLevel level, const char* fmt) {
+    return limiter_.admit(level, fmt);
+  }
+
+  static Backend& instance();
+
+ private:
+  void wake() {
+    wake_.store(true, std::memory_order_release);
+    cv_.notify_one();
+  }
+
+  void wake_maintenance() {
+    maintenance_wake_.store(true, std::memory_order_release);
+    maintenance_cv_.notify_one();
+  }
+
+  void lock_drain() {
+    while (draining_.exchange(true, std::memory_order_acquire)) sched_yield();
+  }
+
+  /* Called with the drain flag held */
+  void open(Sink& sink) {
+    if (sink.fd >= 0) {
+      sink.batch.flush(sink.fd);
+      ::close(sink.fd);
+      sink.fd = -1;
+    }
+
+    std::string path = dir_ + "/" + sink.stem + ".log";
+    struct stat st = {};
+
+    sink.fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                     0644);
+    sink.size = sink.fd >= 0 && fstat(sink.fd, &st) == 0
+                    ? static_cast<std::uint64_t>(st.st_size)
+                    : 0U;
+    sink.opened = now_;
+  }
+
+  /* Called with the drain flag held, never from the crash handler */
+  void rotate(Sink& sink) {
+    std::time_t t = std::chrono::system_clock::to_time_t(now_);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                  now_.time_since_epoch())
+                  .count() %
+              1000;
+    std::tm tm = {};
+    char stamp[32];
+
+    gmtime_r(&t, &tm);
+    std::strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%S", &tm);
+
+    std::string base = dir_ + "/" + sink.stem;
+    std::string rotated;
+    std::error_code ec;
+
+    /* Millisecond stamps keep the names in rotation order; bump on clashes */
+    do {
+      char suffix[8];
+
+      std::snprintf(suffix, sizeof(suffix), "-%03d", static_cast<int>(ms++));
+      rotated = base + "." + stamp + suffix + ".log";
+    } while (fs::exists(rotated + ".gz", ec) || fs::exists(rotated, ec));
+
+    sink.batch.flush(sink.fd);
+    ::close(sink.fd);
+    sink.fd = -1;
+
+    fs::rename(base + ".log", rotated, ec);
+    open(sink);
+
+    /* Do not rotate on every line when the file could not be moved away */
+    if (ec) sink.size = 0;
+
+    wake_maintenance();
+  }
+
+  void write_line(LogLevel level, std::uint16_t id, std::string_view text,
+                  bool crash) {
+    Sink& sink = *sinks_[id < nsinks_.load(std::memory_order_acquire) ? id
+                                                                        : 0];
+
+    if (!crash && logs::collapseRepeats && level == sink.last_level &&
+        text == std::string_view{sink.last, sink.last_len}) {
+      if (sink.repeats++ == 0) sink.repeat_since = now_;
+      return;
+    }
+
+    write_repeats(sink, crash);
+
+    if (text.size() <= sizeof(sink.last)) {
+      std::memcpy(sink.last, text.data(), text.size());
+      sink.last_len = static_cast<std::uint32_t>(text.size());
+      sink.last_level = level;
+    } else {
+      sink.last_level = NONE;
+    }
+
+    emit(sink, level, text, crash);
+  }
+
+  void write_repeats(Sink& sink, bool crash) {
+    if (sink.repeats == 0) return;
+
+    char msg[64];
+    int n = std::snprintf(msg, sizeof(msg), "last message repeated %llu times",
+                          static_cast<unsigned long long>(sink.repeats));
+
+    sink.repeats = 0;
+    emit(sink, sink.last_level, {msg, static_cast<std::size_t>(n)}, crash);
+  }
+
+  void emit(Sink& sink, LogLevel level, std::string_view text, bool crash) {
+    if (!logs::disableFileLogs && sink.fd >= 0) {
+      std::size_t len = prefix(level).size() + text.size() + 1U;
+      auto age = now_ - sink.opened;
+
+      if (!crash && sink.size > 0 &&
+          (sink.size + len > sink.rotation.maxBytes ||
+           (sink.rotation.maxAge.count() > 0 &&
+            age >= sink.rotation.maxAge))) {
+        rotate(sink);
+      }
+
+      if (crash) {
+        /* Bypass the batch, it may be half written by the interrupted
+         * thread */
+        write_all(sink.fd, prefix(level).data(), prefix(level).size());
+        write_all(sink.fd, text.data(), text.size());
+        write_all(sink.fd, "\n", 1U);
+      } else {
+        sink.batch.put(sink.fd, prefix(level));
+        sink.batch.put(sink.fd, text);
+        sink.batch.put(sink.fd, "\n");
+      }
+
+      sink.size += len;
+      sink.dirty = true;
+      sink.sync = sink.sync || level >= logs::flushLevel;
+    }
+
+    if (logs::disableJournal) return;
+
+    Batch& out = crash ? crash_batch_ : out_batch_;
+    std::string_view c = logs::coloredLogs ? color(level) : "";
+
+    if (!logs::coloredLogs) out.put(STDOUT_FILENO, prefix(level));
+
+    out.put(STDOUT_FILENO, c);
+    out.put(STDOUT_FILENO, text);
+    if (!c.empty()) out.put(STDOUT_FILENO, "\033[0m");
+    out.put(STDOUT_FILENO, "\n");
+  }
+
+  void finish(bool crash) {
+    std::size_t n = nsinks_.load(std::memory_order_acquire);
+
+    for (std::size_t i = 0; i < n; i++) {
+      Sink& sink = *sinks_[i];
+
+      /* Collapsed repeats are reported once they are old enough, or when
+       * this is the last drain */
+      if (sink.repeats > 0 &&
+          (crash || !running_.load(std::memory_order_relaxed) ||
+           now_ - sink.repeat_since >= logs::repeatInterval)) {
+        write_repeats(sink, crash);
+      }
+
+      if (!sink.dirty) continue;
+
+      if (!crash) sink.batch.flush(sink.fd);
+      if (sink.sync && sink.fd >= 0) fdatasync(sink.fd);
+
+      sink.dirty = false;
+      sink.sync = false;
+    }
+
+    (crash ? crash_batch_ : out_batch_).flush(STDOUT_FILENO);
+  }
+
+  /* Too long for a slot: drain first to keep the ordering, then write it
+   * straight from the calling thread */
+  void write_long(LogLevel level, std::uint16_t sink, std::string_view text) {
+    std::lock_guard<std::recursive_mutex> guard{logs::logMutex};
+
+    drain(true);
+    lock_drain();
+
+    now_ = std::chrono::system_clock::now();
+    write_line(level, sink, text, false);
+    finish(false);
+
+    draining_.store(false, std::memory_order_release);
+  }
+
+  void workTask(std::stop_token stoken) {
+    std::mutex mtx;
+    std::unique_lock<std::mutex> lock{mtx};
+
+    while (!stoken.stop_requested()) {
+      cv_.wait_for(lock, stoken, logs::flushInterval, [this] {
+        return wake_.exchange(false, std::memory_order_acquire);
+      });
+
+      drain(true);
+      limiter_.sweep();
+    }
+  }
+
+  /* Compression and retention run here, away from the writer, at the
+   * lowest CPU priority */
+  void maintenanceTask(std::stop_token stoken) {
+    std::mutex mtx;
+    std::unique_lock<std::mutex> lock{mtx};
+
+    setpriority(PRIO_PROCESS, static_cast<id_t>(gettid()), 19);
+
+    while (!stoken.stop_requested()) {
+      maintenance_cv_.wait_for(lock, stoken, MAINTENANCE_INTERVAL, [this] {
+        return maintenance_wake_.exchange(false, std::memory_order_acquire);
+      });
+
+      if (!stoken.stop_requested()) maintain(stoken);
+    }
+  }
+
+  void maintain(std::stop_token const& stoken) {
+    struct File {
+      fs::path path;
+      std::string stamp;
+      std::uint64_t size;
+    };
+
+    std::string dir;
+    std::vector<std::pair<std::string, logs::Rotation>> sinks;
+
+    {
+      std::lock_guard<std::mutex> lock{config_mtx_};
+
+      dir = dir_;
+      for (std::size_t i = 0; i < nsinks_.load(); i++) {
+        sinks.emplace_back(sinks_[i]->stem, sinks_[i]->rotation);
+      }
+    }
+
+    if (dir.empty()) return;
+
+    std::error_code ec;
+    std::vector<File> all;
+    std::uint64_t total = 0;
+
+    for (auto const& [stem, rotation] : sinks) {
+      std::vector<File> files;
+
+      for (auto const& entry : fs::directory_iterator{dir, ec}) {
+        std::string name = entry.path().filename().string();
+        std::string_view stamp = rotated_stamp(name, stem);
+
+        if (name == stem + ".log") total += entry.file_size(ec);
+        if (stamp.empty()) continue;
+
+        fs::path path = entry.path();
+
+        if (rotation.compress && path.extension() == ".log" &&
+            compress(path, stoken)) {
+          path += ".gz";
+        }
+
+        files.push_back({path, std::string{stamp}, fs::file_size(path, ec)});
+      }
+
+      /* Newest first */
+      std::sort(files.begin(), files.end(),
+                [](auto const& a, auto const& b) { return a.stamp > b.stamp; });
+
+      for (std::size_t i = 0; i < files.size(); i++) {
+        if (i >= rotation.keep) {
+          fs::remove(files[i].path, ec);
+        } else {
+          total += files[i].size;
+          all.push_back(std::move(files[i]));
+        }
+      }
+    }
+
+    std::sort(all.begin(), all.end(),
+              [](auto const& a, auto const& b) { return a.stamp < b.stamp; });
+
+    for (auto const& file : all) {
+      if (total <= logs::diskBudget) break;
+
+      if (fs::remove(file.path, ec)) total -= file.size;
+    }
+  }
+
+  void install_crash_handlers() {
+    for (int sig : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT}) {
+      struct sigaction old = {};
+
+      /* Leave handlers installed by the application alone */
+      if (sigaction(sig, nullptr, &old) < 0 || old.sa_handler != SIG_DFL) {
+        continue;
+      }
+
+      struct sigaction sa = {};
+
+      sa.sa_handler = crash;
+      sa.sa_flags = SA_RESETHAND;
+      sigemptyset(&sa.sa_mask);
+      sigaction(sig, &sa, nullptr);
+    }
+  }
+
+  Ring ring_;
+  Limiter limiter_;
+  std::array<std::unique_ptr<Sink>, MAX_SINKS> sinks_;
+  std::atomic<std::size_t> nsinks_ = 0;
+  /* dir_ and service_ change with both config_mtx_ and the drain flag held */
+  std::mutex config_mtx_;
+  std::string dir_;
+  std::string service_ = DEFAULT_SERVICE;
+  std::chrono::system_clock::time_point now_;
+  std::atomic<bool> draining_ = false;
+  std::atomic<bool> running_ = true;
+  std::atomic<bool> wake_ = false;
+  std::atomic<bool> maintenance_wake_ = false;
+  std::atomic<std::uint64_t> dropped_ = 0;
+  std::condition_variable_any cv_;
+  std::condition_variable_any maintenance_cv_;
+  static inline Batch out_batch_;
+  static inline Batch crash_batch_;
+  std::jthread thread_;
+  std::jthread maintenance_;
+};
+
+Backend& Backend::instance() {
+  /* Never destroyed, threads may still log while statics are torn down */
+  static Backend* backend = new Backend{};
+  return *backend;
+}
+
+void Limiter::report(Site& site) {
+  std::uint32_t suppressed =
+      site.suppressed.exchange(0, std::memory_order_relaxed);
+
+  if (suppressed == 0) return;
+
+  std::string_view fmt{site.fmt.load(std::memory_order_relaxed)};
+
+  while (!fmt.empty() && fmt.back() == '\n') fmt.remove_suffix(1U);
+
+  char msg[SLOT_TEXT];
+  int n = std::snprintf(msg, sizeof(msg), "%u messages suppressed: \"%.*s\"",
+                        suppressed, static_cast<int>(fmt.size()), fmt.data());
+
+  Backend::instance().enqueue(
+      site.level.load(std::memory_order_relaxed), 0,
+      {msg, std::min(static_cast<std::size_t>(n), sizeof(msg) - 1U)});
+}
+
+void format_and_enqueue(const LogLevel level, std::uint16_t sink,
+                        const char* fmt, va_list args) {
+  char buf[SLOT_TEXT + 1U];
+  va_list copy;
+
+  va_copy(copy, args);
+
+  int n = std::vsnprintf(buf, sizeof(buf), fmt, args);
+
+  if (n < 0) {
+    va_end(copy);
+    return;
+  }
+
+  if (static_cast<std::size_t>(n) < sizeof(buf)) {
+    va_end(copy);
+    Backend::instance().enqueue(level, sink,
+                                {buf, static_cast<std::size_t>(n)});
+    return;
+  }
+
+  char* allocFmt;
+
+  if (vasprintf(&allocFmt, fmt, copy) < 0) {
+    va_end(copy);
+    logs::log(ERR, "Failed to allocated log string!!");
+    return;
+  }
+
+  va_end(copy);
+
+  Backend::instance().enqueue(level, sink, allocFmt);
+
+  free(allocFmt);
+}
+
+}  // namespace
+
+void logs::init(std::string log_dir, std::string service) {
+  if (service.empty()) service = DEFAULT_SERVICE;
+
+  logFile = log_dir + "/" + service + ".log";
+
+  if (!std::filesystem::exists(log_dir))
+    std::filesystem::create_directories(log_dir);
+
+  if (!Backend::instance().configure(log_dir, service)) {
+    log(ERR, "Failed to open log file %s\n", logFile.c_str());
+  }
+}
+
+void logs::log(const LogLevel level, std::string_view str) {
+  if (level < logs::global_log_level) return;
+
+  Backend::instance().enqueue(level, 0, str);
+}
+
+void logs::vlog(const LogLevel level, const char* fmt, va_list args) {
+  if (level < logs::global_log_level || !admit(level, fmt)) return;
+
+  format_and_enqueue(level, 0, fmt, args);
+}
+
+bool logs::admit(const LogLevel level, const char* fmt) {
+  return Backend::instance().admit(level, fmt);
+}
+
+void logs::flush() { Backend::instance().drain(true); }
+
+void logs::shutdown() { Backend::instance().stop(); }
+
+logs::Component::Component(std::string name, Rotation const& rotation)
+    : sink_{Backend::instance().add_sink(std::move(name), rotation)} {}
+
+void logs::Component::log(const LogLevel level, std::string_view str) const {
+  if (level < logs::global_log_level) return;
+
+  Backend::instance().enqueue(level, sink_, str);
+}
+
+void logs::Component::log(const LogLevel level, const char* fmt, ...) const {
+  va_list args;
+
+  if (level < logs::global_log_level || !admit(level, fmt)) return;
 
-  if (!disableJournal) std::cout << ((coloredLogs) ? coloredStr : out) << '\n';
+  va_start(args, fmt);
+  format_and_enqueue(level, sink_, fmt, args);
+  va_end(args);
 }
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <fsatutils/metrics/metrics.hpp>
+#include <vector>
+
+namespace fsatutils {
+
+namespace metrics {
+
+namespace {
+
+template <typename T, typename Map>
+T& lookup(Map& map, std::mutex& mtx, std::string_view name) {
+  std::lock_guard<std::mutex> lock{mtx};
+  auto it = map.find(name);
+
+  if (it == map.end()) {
+    it = map.emplace(std::string{name}, std::make_unique<T>()).first;
+  }
+
+  return *it->second;
+}
+
+}  // namespace
+
+std::size_t shard() noexcept {
+  static std::atomic<std::size_t> next = 0;
+  thread_local std::size_t index =
+      next.fetch_add(1U, std::memory_order_relaxed) % SHARDS;
+
+  return index;
+}
+
+std::uint64_t Counter::value() const noexcept {
+  std::uint64_t total = 0;
+
+  for (auto const& s : shards_) {
+    total += s.value.load(std::memory_order_relaxed);
+  }
+
+  return total;
+}
+
+template <std::size_t Shards>
+HistogramSnapshot BasicHistogram<Shards>::snapshot() const {
+  std::vector<std::uint64_t> counts(BUCKETS);
+  HistogramSnapshot snap = {};
+
+  snap.min = ~std::uint64_t{0};
+
+  for (auto const& s : shards_) {
+    for (std::size_t i = 0; i < BUCKETS; i++) {
+      counts[i] += s.counts[i].load(std::memory_order_relaxed);
+    }
+
+    snap.sum += s.sum.load(std::memory_order_relaxed);
+    snap.min = std::min(snap.min, s.min.load(std::memory_order_relaxed));
+    snap.max = std::max(snap.max, s.max.load(std::memory_order_relaxed));
+  }
+
+  /* The count is taken from the buckets so percentiles stay consistent
+   * with concurrent updates */
+  for (auto c : counts) snap.count += c;
+
+  if (snap.count == 0) return {};
+
+  std::uint64_t* targets[] = {&snap.p50, &snap.p90, &snap.p99, &snap.p999};
+  const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+  std::uint64_t seen = 0;
+  std::size_t q = 0;
+
+  for (std::size_t i = 0; i < BUCKETS && q < std::size(quantiles); i++) {
+    seen += counts[i];
+
+    while (q < std::size(quantiles) &&
+           static_cast<double>(seen) >=
+               quantiles[q] * static_cast<double>(snap.count)) {
+      *targets[q++] = std::min(upper_bound(i), snap.max);
+    }
+  }
+
+  return snap;
+}
+
+template class BasicHistogram<SHARDS>;
+template class BasicHistogram<1U>;
+
+Counter& Registry::counter(std::string_view name) {
+  return lookup<Counter>(counters_, mtx_, name);
+}
+
+Gauge& Registry::gauge(std::string_view name) {
+  return lookup<Gauge>(gauges_, mtx_, name);
+}
+
+Histogram& Registry::histogram(std::string_view name) {
+  return lookup<Histogram>(histograms_, mtx_, name);
+}
+
+nlohmann::json Registry::snapshot() const {
+  std::lock_guard<std::mutex> lock{mtx_};
+  nlohmann::json j;
+
+  j["counters"] = nlohmann::json::object();
+  j["gauges"] = nlohmann::json::object();
+  j["histograms"] = nlohmann::json::object();
+
+  for (auto const& [name, c] : counters_) j["counters"][name] = c->value();
+  for (auto const& [name, g] : gauges_) j["gauges"][name] = g->value();
+
+  for (auto const& [name, h] : histograms_) {
+    HistogramSnapshot s = h->snapshot();
+
+    j["histograms"][name] = {
+        {"count", s.count}, {"sum", s.sum}, {"min", s.min},
+        {"max", s.max},     {"p50", s.p50}, {"p90", s.p90},
+        {"p99", s.p99},     {"p999", s.p999},
+    };
+  }
+
+  return j;
+}
+
+Registry& Registry::global() {
+  /* Never destroyed, metrics may still be updated during static teardown */
+  static Registry* registry = new Registry{};
+  return *registry;
+}
+
+}  // namespace metrics
+
+}  // namespace fsatutils
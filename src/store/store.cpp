@@ -0,0 +1,521 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fsatutils/errors.hpp>
+#include <fsatutils/log/log.hpp>
+#include <fsatutils/store/store.hpp>
+#include <limits>
+#include <mutex>
+
+namespace fsatutils {
+
+namespace store {
+
+namespace {
+
+constexpr char SEGMENT_MAGIC[8] = {'F', 'S', 'A', 'T', 'S', 'E', 'G', '\0'};
+constexpr std::uint16_t SEGMENT_VERSION = 1;
+
+struct SegmentHeader {
+  char magic[8];
+  std::uint16_t version;
+  std::uint16_t reserved;
+  std::uint32_t block;
+  std::uint64_t capacity;
+  std::uint64_t count;
+  std::uint64_t reserved2[4];
+};
+
+static_assert(sizeof(SegmentHeader) == 64U);
+
+struct BlockSummary {
+  double min;
+  double max;
+  double sum;
+  std::uint64_t count;
+};
+
+/* Series names become directory names; anything outside a safe set is
+ * percent-encoded so "dev0/voltage0/raw" maps to one directory */
+std::string encode_name(std::string_view name) {
+  std::string out;
+
+  for (char c : name) {
+    if (std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-' ||
+        c == '.') {
+      out += c;
+      continue;
+    }
+
+    char hex[4];
+    std::snprintf(hex, sizeof(hex), "%%%02X", static_cast<unsigned char>(c));
+    out += hex;
+  }
+
+  return out;
+}
+
+std::string decode_name(std::string_view name) {
+  std::string out;
+
+  for (std::size_t i = 0; i < name.size(); i++) {
+    if (name[i] == '%' && i + 2 < name.size()) {
+      out += static_cast<char>(
+          std::strtol(std::string{name.substr(i + 1, 2)}.c_str(), nullptr, 16));
+      i += 2;
+      continue;
+    }
+
+    out += name[i];
+  }
+
+  return out;
+}
+
+}  // namespace
+
+class Segment {
+ public:
+  Segment(std::string const& path, std::size_t capacity, bool create) {
+    int fd = ::open(path.c_str(),
+                    create ? (O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC)
+                           : (O_RDWR | O_CLOEXEC),
+                    0644);
+
+    if (fd < 0) {
+      throw_runtime_error("Failed to open store segment " + path + "!");
+    }
+
+    if (create) {
+      size_ = bytes(capacity);
+
+      if (ftruncate(fd, static_cast<off_t>(size_)) < 0) {
+        ::close(fd);
+        throw_runtime_error("Failed to size store segment " + path + "!");
+      }
+    } else {
+      struct stat st;
+
+      if (fstat(fd, &st) < 0) {
+        ::close(fd);
+        throw_runtime_error("Failed to stat store segment " + path + "!");
+      }
+
+      size_ = static_cast<std::size_t>(st.st_size);
+    }
+
+    void* map = (size_ >= sizeof(SegmentHeader))
+                    ? mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                           fd, 0)
+                    : MAP_FAILED;
+
+    ::close(fd);
+
+    if (map == MAP_FAILED) {
+      throw_runtime_error("Failed to map store segment " + path + "!");
+    }
+
+    map_ = static_cast<std::uint8_t*>(map);
+    hdr_ = reinterpret_cast<SegmentHeader*>(map_);
+
+    if (create) {
+      std::memcpy(hdr_->magic, SEGMENT_MAGIC, sizeof(hdr_->magic));
+      hdr_->version = SEGMENT_VERSION;
+      hdr_->block = Store::SUMMARY_BLOCK;
+      hdr_->capacity = capacity;
+      hdr_->count = 0;
+    } else if (std::memcmp(hdr_->magic, SEGMENT_MAGIC, 8) != 0 ||
+               hdr_->version != SEGMENT_VERSION ||
+               hdr_->block != Store::SUMMARY_BLOCK ||
+               bytes(hdr_->capacity) > size_ ||
+               hdr_->count > hdr_->capacity) {
+      munmap(map_, size_);
+      throw_runtime_error("Invalid store segment " + path + "!");
+    }
+
+    capacity_ = hdr_->capacity;
+    ts_ = reinterpret_cast<std::uint64_t*>(map_ + sizeof(SegmentHeader));
+    values_ = reinterpret_cast<double*>(ts_ + capacity_);
+    summaries_ = reinterpret_cast<BlockSummary*>(values_ + capacity_);
+  }
+
+  ~Segment() { munmap(map_, size_); }
+
+  static std::size_t bytes(std::size_t capacity) {
+    return sizeof(SegmentHeader) +
+           capacity * (sizeof(std::uint64_t) + sizeof(double)) +
+           (capacity / Store::SUMMARY_BLOCK) * sizeof(BlockSummary);
+  }
+
+  /* Only the appending thread writes count_, readers see a prefix of the
+   * columns that is fully written thanks to the release store */
+  std::size_t count() const {
+    return std::atomic_ref<std::uint64_t>{hdr_->count}.load(
+        std::memory_order_acquire);
+  }
+
+  bool full() const { return count() == capacity_; }
+
+  void append(std::uint64_t ts, double value) {
+    std::size_t n = hdr_->count;
+    BlockSummary& s = summaries_[n / Store::SUMMARY_BLOCK];
+
+    ts_[n] = ts;
+    values_[n] = value;
+
+    if (n % Store::SUMMARY_BLOCK == 0U) {
+      s = {value, value, value, 1U};
+    } else {
+      s.min = std::min(s.min, value);
+      s.max = std::max(s.max, value);
+      s.sum += value;
+      s.count++;
+    }
+
+    std::atomic_ref<std::uint64_t>{hdr_->count}.store(
+        n + 1U, std::memory_order_release);
+  }
+
+  std::span<const std::uint64_t> timestamps(std::size_t n) const {
+    return {ts_, n};
+  }
+
+  std::span<const double> values(std::size_t n) const { return {values_, n}; }
+
+  BlockSummary const& summary(std::size_t block) const {
+    return summaries_[block];
+  }
+
+  void flush() const { msync(map_, size_, MS_ASYNC); }
+
+  Segment(const Segment&) = delete;
+  Segment& operator=(const Segment&) = delete;
+
+ private:
+  std::uint8_t* map_;
+  std::size_t size_;
+  SegmentHeader* hdr_;
+  std::size_t capacity_;
+  std::uint64_t* ts_;
+  double* values_;
+  BlockSummary* summaries_;
+};
+
+class Store::Series {
+ public:
+  Series(std::string dir, std::size_t capacity)
+      : dir_{std::move(dir)}, capacity_{capacity} {
+    std::filesystem::create_directories(dir_);
+
+    std::vector<std::string> files;
+
+    for (auto const& entry : std::filesystem::directory_iterator{dir_}) {
+      if (entry.path().extension() == ".seg") {
+        files.push_back(entry.path().string());
+      }
+    }
+
+    /* Zero-padded sequence numbers sort chronologically */
+    std::sort(files.begin(), files.end());
+
+    for (auto const& file : files) {
+      try {
+        auto seg = std::make_shared<Segment>(file, 0, false);
+
+        if (seg->count() > 0U) segments_.push_back(std::move(seg));
+      } catch (const std::exception& e) {
+        logs::log(ERR, "Skipping store segment %s: %s\n", file.c_str(),
+                  e.what());
+      }
+
+      std::string stem = std::filesystem::path{file}.stem().string();
+      next_ = std::max<std::uint64_t>(
+          next_, std::strtoull(stem.c_str(), nullptr, 10) + 1U);
+    }
+
+    if (!segments_.empty()) {
+      auto const& tail = segments_.back();
+      last_ts_ = tail->timestamps(tail->count()).back();
+    }
+  }
+
+  bool append(std::uint64_t ts, double value) {
+    if (ts < last_ts_) return false;
+
+    if (segments_.empty() || segments_.back()->full()) {
+      char name[32];
+      std::snprintf(name, sizeof(name), "/%016llu.seg",
+                    static_cast<unsigned long long>(next_++));
+
+      auto seg = std::make_shared<Segment>(dir_ + name, capacity_, true);
+
+      std::lock_guard<std::mutex> guard{segments_mtx_};
+      segments_.push_back(std::move(seg));
+    }
+
+    segments_.back()->append(ts, value);
+    last_ts_ = ts;
+
+    return true;
+  }
+
+  std::vector<std::shared_ptr<const Segment>> snapshot() {
+    std::lock_guard<std::mutex> guard{segments_mtx_};
+    return {segments_.begin(), segments_.end()};
+  }
+
+  void flush() {
+    std::lock_guard<std::mutex> guard{segments_mtx_};
+    if (!segments_.empty()) segments_.back()->flush();
+  }
+
+  std::mutex append_mtx;
+
+ private:
+  std::string dir_;
+  std::size_t capacity_;
+  std::uint64_t next_ = 0;
+  std::uint64_t last_ts_ = 0;
+  std::mutex segments_mtx_;
+  std::vector<std::shared_ptr<Segment>> segments_;
+};
+
+std::size_t Range::size() const noexcept {
+  std::size_t n = 0;
+
+  for (auto const& s : slices_) n += s.values.size();
+
+  return n;
+}
+
+Store::Store(std::string dir, std::size_t segment_samples)
+    : dir_{std::move(dir)},
+      segment_samples_{((std::max<std::size_t>(segment_samples, 1U) +
+                         SUMMARY_BLOCK - 1U) /
+                        SUMMARY_BLOCK) *
+                       SUMMARY_BLOCK} {
+  std::error_code ec;
+
+  std::filesystem::create_directories(dir_, ec);
+
+  if (ec) {
+    throw_runtime_error("Failed to create store directory " + dir_ + "!");
+  }
+
+  for (auto const& entry : std::filesystem::directory_iterator{dir_}) {
+    if (!entry.is_directory()) continue;
+
+    std::string name = decode_name(entry.path().filename().string());
+
+    series_[name] =
+        std::make_unique<Series>(entry.path().string(), segment_samples_);
+  }
+
+  logs::log(INFO, "Opened telemetry store %s: %zu series\n", dir_.c_str(),
+            series_.size());
+}
+
+Store::~Store() { flush(); }
+
+Store::Series* Store::find(std::string_view name, bool create) {
+  {
+    std::shared_lock<std::shared_mutex> lock{mtx_};
+
+    if (auto it = series_.find(name); it != series_.end()) {
+      return it->second.get();
+    }
+  }
+
+  if (!create) return nullptr;
+
+  std::unique_lock<std::shared_mutex> lock{mtx_};
+  auto& s = series_[std::string{name}];
+
+  if (!s) {
+    s = std::make_unique<Series>(dir_ + "/" + encode_name(name),
+                                 segment_samples_);
+  }
+
+  return s.get();
+}
+
+bool Store::append(std::string_view series, std::uint64_t ts, double value) {
+  return append(series, {&ts, 1U}, {&value, 1U}) == 1U;
+}
+
+std::size_t Store::append(std::string_view series,
+                          std::span<const std::uint64_t> ts,
+                          std::span<const double> values) {
+  std::size_t n = std::min(ts.size(), values.size());
+  std::size_t appended = 0;
+
+  try {
+    Series* s = find(series, true);
+    std::lock_guard<std::mutex> guard{s->append_mtx};
+
+    for (std::size_t i = 0; i < n; i++) {
+      if (s->append(ts[i], values[i])) appended++;
+    }
+  } catch (const std::exception& e) {
+    logs::log(ERR, "Failed to append to series %.*s: %s\n",
+              static_cast<int>(series.size()), series.data(), e.what());
+  }
+
+  rejected_.fetch_add(n - appended, std::memory_order_relaxed);
+
+  return appended;
+}
+
+Range Store::query(std::string_view series, std::uint64_t from,
+                   std::uint64_t to) {
+  Range range;
+  Series* s = find(series, false);
+
+  if (s == nullptr || from >= to) return range;
+
+  for (auto& seg : s->snapshot()) {
+    std::size_t n = seg->count();
+
+    if (n == 0U) continue;
+
+    auto ts = seg->timestamps(n);
+
+    if (ts.back() < from) continue;
+    if (ts.front() >= to) break;
+
+    auto lo = std::lower_bound(ts.begin(), ts.end(), from) - ts.begin();
+    auto hi = std::lower_bound(ts.begin() + lo, ts.end(), to) - ts.begin();
+
+    if (lo == hi) continue;
+
+    range.slices_.push_back({
+        .timestamps = ts.subspan(lo, hi - lo),
+        .values = seg->values(n).subspan(lo, hi - lo),
+    });
+    range.segments_.push_back(std::move(seg));
+  }
+
+  return range;
+}
+
+std::vector<Bucket> Store::rollup(std::string_view series, std::uint64_t from,
+                                  std::uint64_t to, std::uint64_t bucket_ns) {
+  std::vector<Bucket> buckets;
+  Range range = query(series, from, to);
+
+  if (bucket_ns == 0U) return buckets;
+
+  auto add = [&](std::uint64_t ts, double min, double max, double sum,
+                 std::uint64_t count) {
+    std::uint64_t start = from + ((ts - from) / bucket_ns) * bucket_ns;
+
+    if (buckets.empty() || buckets.back().start_ns != start) {
+      buckets.push_back({start, 0U, min, max, 0.0});
+    }
+
+    Bucket& b = buckets.back();
+    b.count += count;
+    b.min = std::min(b.min, min);
+    b.max = std::max(b.max, max);
+    b.mean += sum; /* holds the sum until the end */
+  };
+
+  for (std::size_t k = 0; k < range.slices_.size(); k++) {
+    auto const& slice = range.slices_[k];
+    auto const& seg = range.segments_[k];
+    auto seg_ts = seg->timestamps(seg->count());
+    std::size_t base = slice.timestamps.data() - seg_ts.data();
+    std::size_t i = 0;
+
+    while (i < slice.values.size()) {
+      std::size_t pos = base + i;
+
+      /* Whole summary blocks inside one bucket skip the per-sample scan */
+      if (pos % SUMMARY_BLOCK == 0U && i + SUMMARY_BLOCK <= slice.values.size()) {
+        std::uint64_t first = slice.timestamps[i];
+        std::uint64_t last = slice.timestamps[i + SUMMARY_BLOCK - 1U];
+
+        if ((first - from) / bucket_ns == (last - from) / bucket_ns) {
+          auto const& sum = seg->summary(pos / SUMMARY_BLOCK);
+
+          add(first, sum.min, sum.max, sum.sum, sum.count);
+          i += SUMMARY_BLOCK;
+          continue;
+        }
+      }
+
+      double v = slice.values[i];
+
+      add(slice.timestamps[i], v, v, v, 1U);
+      i++;
+    }
+  }
+
+  for (auto& b : buckets) b.mean /= static_cast<double>(b.count);
+
+  return buckets;
+}
+
+std::vector<std::string> Store::series() const {
+  std::shared_lock<std::shared_mutex> lock{mtx_};
+  std::vector<std::string> names;
+
+  for (auto const& [name, s] : series_) names.push_back(name);
+
+  return names;
+}
+
+void Store::flush() {
+  std::shared_lock<std::shared_mutex> lock{mtx_};
+
+  for (auto const& [name, s] : series_) s->flush();
+}
+
+iio::Sampler::Callback Store::sampler_sink() {
+  return [this](iio::Sample const& sample) {
+    char* end;
+    double value = std::strtod(sample.value.c_str(), &end);
+
+    if (end == sample.value.c_str()) return;
+
+    std::string name = sample.device + "/" + sample.channel + "/" + sample.attr;
+
+    if (!append(name, sample.wall_ns, value)) {
+      logs::log(WARN, "Dropped sample of %s older than the stored series\n",
+                name.c_str());
+    }
+  };
+}
+
+iio::CaptureGroup::FrameCallback Store::capture_sink(
+    std::vector<std::vector<std::string>> series) {
+  return [this, series = std::move(series)](
+             iio::CaptureGroup::Frame const& frame) {
+    std::size_t offset = 0;
+
+    for (std::size_t dev = 0; dev < series.size(); dev++) {
+      auto const& names = series[dev];
+      bool gap = dev < 64U && (frame.gap_mask & (1ULL << dev)) != 0U;
+
+      for (std::size_t i = 0; i < names.size(); i++) {
+        if (offset + i >= frame.values.size()) return;
+        if (!gap) append(names[i], frame.timestamp_ns, frame.values[offset + i]);
+      }
+
+      offset += names.size();
+    }
+  };
+}
+
+}  // namespace store
+
+}  // namespace fsatutils
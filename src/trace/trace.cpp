@@ -0,0 +1,186 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <fsatutils/log/log.hpp>
+#include <fsatutils/trace/trace.hpp>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <vector>
+
+namespace fsatutils {
+
+namespace trace {
+
+namespace {
+
+/* The lock is only contended while exporting */
+struct Ring {
+  std::mutex mtx;
+  std::array<Event, RING_EVENTS> events;
+  std::uint64_t next = 0;
+  pid_t tid = gettid();
+  bool retired = false;
+};
+
+class Rings {
+ public:
+  Ring& local() {
+    struct Local {
+      Local() : ring{Rings::instance().attach()} {}
+      ~Local() {
+        std::lock_guard<std::mutex> lock{ring->mtx};
+        ring->retired = true;
+      }
+
+      std::shared_ptr<Ring> ring;
+    };
+
+    thread_local Local local;
+
+    return *local.ring;
+  }
+
+  std::vector<std::shared_ptr<Ring>> all() {
+    std::lock_guard<std::mutex> lock{mtx_};
+    return rings_;
+  }
+
+  /* Forgets rings of exited threads once their events have been handed out */
+  void drop(std::vector<Ring*> const& retired) {
+    if (retired.empty()) return;
+
+    std::lock_guard<std::mutex> lock{mtx_};
+
+    std::erase_if(rings_, [&retired](auto const& ring) {
+      return std::find(retired.begin(), retired.end(), ring.get()) !=
+             retired.end();
+    });
+  }
+
+  static Rings& instance() {
+    /* Never destroyed, threads may still trace while statics are torn down */
+    static Rings* rings = new Rings{};
+    return *rings;
+  }
+
+ private:
+  /* Rings outlive their threads until the next export or clear, so late
+   * exports still see their events */
+  std::shared_ptr<Ring> attach() {
+    auto ring = std::make_shared<Ring>();
+    std::lock_guard<std::mutex> lock{mtx_};
+
+    rings_.push_back(ring);
+
+    return ring;
+  }
+
+  std::mutex mtx_;
+  std::vector<std::shared_ptr<Ring>> rings_;
+};
+
+}  // namespace
+
+std::uint64_t new_trace_id() {
+  thread_local std::mt19937_64 rng{std::random_device{}()};
+  std::uint64_t id;
+
+  do {
+    id = rng();
+  } while (id == 0U);
+
+  return id;
+}
+
+void record(Event const& event) {
+  Ring& ring = Rings::instance().local();
+  std::lock_guard<std::mutex> lock{ring.mtx};
+
+  ring.events[ring.next++ % RING_EVENTS] = event;
+}
+
+std::string export_json() {
+  using json = nlohmann::json;
+
+  json events = json::array();
+  pid_t pid = getpid();
+
+  events.push_back({{"name", "process_name"},
+                    {"ph", "M"},
+                    {"pid", pid},
+                    {"args", {{"name", program_invocation_short_name}}}});
+
+  std::vector<Ring*> retired;
+
+  for (auto const& ring : Rings::instance().all()) {
+    std::lock_guard<std::mutex> lock{ring->mtx};
+    std::uint64_t first =
+        ring->next > RING_EVENTS ? ring->next - RING_EVENTS : 0U;
+
+    for (std::uint64_t i = first; i < ring->next; i++) {
+      Event const& e = ring->events[i % RING_EVENTS];
+      json ev = {
+          {"name", e.name},
+          {"cat", e.category},
+          {"ph", "X"},
+          {"ts", static_cast<double>(e.start_ns) / 1e3},
+          {"dur", static_cast<double>(e.dur_ns) / 1e3},
+          {"pid", pid},
+          {"tid", ring->tid},
+      };
+
+      if (e.trace_id != 0U) {
+        char id[17];
+
+        std::snprintf(id, sizeof(id), "%016llx",
+                      static_cast<unsigned long long>(e.trace_id));
+        ev["args"] = {{"trace_id", id}};
+      }
+
+      events.push_back(std::move(ev));
+    }
+
+    if (ring->retired) retired.push_back(ring.get());
+  }
+
+  Rings::instance().drop(retired);
+
+  return json{{"traceEvents", std::move(events)}, {"displayTimeUnit", "ns"}}
+      .dump();
+}
+
+bool export_json(std::string const& path) {
+  std::ofstream ofs{path, std::ios::out | std::ios::trunc};
+
+  if (!ofs) {
+    logs::log(ERR, "Failed to open trace file %s\n", path.c_str());
+    return false;
+  }
+
+  ofs << export_json();
+
+  return static_cast<bool>(ofs);
+}
+
+void clear() {
+  std::vector<Ring*> retired;
+
+  for (auto const& ring : Rings::instance().all()) {
+    std::lock_guard<std::mutex> lock{ring->mtx};
+    ring->next = 0;
+
+    if (ring->retired) retired.push_back(ring.get());
+  }
+
+  Rings::instance().drop(retired);
+}
+
+}  // namespace trace
+
+}  // namespace fsatutils
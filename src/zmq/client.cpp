@@ -3,13 +3,17 @@
 #include <array>
 #include <fsatutils/errors.hpp>
 #include <fsatutils/log/log.hpp>
+#include <fsatutils/trace/trace.hpp>
 #include <fsatutils/zmq/client.hpp>
 #include <fsatutils/zmq/zmq_engine.hpp>
 #include <fsatutils/zmq/zprotocol.hpp>
 #include <iostream>
 #include <memory>
 #include <nlohmann/json.hpp>
+#include <random>
+#include <string>
 #include <thread>
+#include <unordered_map>
 
 using json = nlohmann::json;
 
@@ -23,26 +27,87 @@ class Client::impl {
 
   bool sendCommand(std::string_view service, Client::CommandRequest& req);
 
+  bool send(std::string_view service, std::span<const std::string> segments,
+            std::span<const std::string> values);
+
   bool sendDiscover();
 
   bool recvAndLogResponses();
 
   bool publishRawBytes(std::string_view topic, std::span<std::uint8_t> data);
 
+  void setHeaderVersion(std::uint8_t version) noexcept {
+    header_version_ = version;
+  }
+
  private:
+  struct NameHash {
+    using is_transparent = void;
+
+    std::size_t operator()(std::string_view name) const noexcept {
+      return std::hash<std::string_view>{}(name);
+    }
+  };
+
+  bool sendPayload(std::string_view service);
+
   ZMQEngine engine_;
   std::string host_;
+  std::uint64_t sender_id_;
+  /* v2 sequence numbers are per destination service */
+  std::unordered_map<std::string, std::uint64_t, NameHash, std::equal_to<>>
+      seq_;
+  /* Reused payload buffer, commands are encoded straight into it */
+  std::string tx_;
+  std::uint8_t header_version_ = 1;
 };
 
 Client::Client(std::string host) : impl_{std::make_unique<impl>(host)} {}
 
 Client::~Client() = default;
 
+void Client::setHeaderVersion(std::uint8_t version) noexcept {
+  impl_->setHeaderVersion(version);
+}
+
 bool Client::sendCommand(std::string_view service,
                          Client::CommandRequest& req) {
   return impl_->sendCommand(service, req);
 }
 
+Client::PreparedCommand Client::prepare(
+    std::string_view service, std::string_view name,
+    std::vector<std::string> const& argNames) {
+  PreparedCommand cmd;
+  std::string seg = "{\"command\":";
+
+  appendJSONString(seg, name);
+  seg += ",\"args\":[";
+
+  for (std::size_t i = 0; i < argNames.size(); i++) {
+    if (i > 0) seg += "},";
+
+    seg += "{\"name\":";
+    appendJSONString(seg, argNames[i]);
+    seg += ",\"value\":";
+
+    cmd.segments_.push_back(std::move(seg));
+    seg.clear();
+  }
+
+  seg += argNames.empty() ? "]}" : "}]}";
+
+  cmd.segments_.push_back(std::move(seg));
+  cmd.values_.resize(argNames.size());
+  cmd.service_ = service;
+
+  return cmd;
+}
+
+bool Client::send(PreparedCommand const& cmd) {
+  return impl_->send(cmd.service_, cmd.segments_, cmd.values_);
+}
+
 bool Client::sendDiscover() { return impl_->sendDiscover(); }
 
 bool Client::recvAndLogResponses() { return impl_->recvAndLogResponses(); }
@@ -54,9 +119,13 @@ bool Client::publishRawBytes(std::string_view topic,
 
 Client::impl::impl(std::string host)
     : engine_{host, ZMQ_FLATSAT_ENGINE_XPUB_PORT, ZMQ_FLATSAT_ENGINE_XSUB_PORT},
-      host_{host} {
+      host_{host},
+      sender_id_{std::random_device{}() |
+                 (std::uint64_t{std::random_device{}()} << 32U)} {
   using namespace std::chrono_literals;
 
+  tx_.reserve(ZMQ_FLATSAT_ENGINE_MTU);
+
   /* Make sure subscribers can be registered */
   std::this_thread::sleep_for(100ms);
 
@@ -68,26 +137,75 @@ Client::impl::impl(std::string host)
 
 bool Client::impl::sendCommand(std::string_view service,
                                Client::CommandRequest& req) {
-  json command;
+  std::uint64_t trace_id = 0;
+
+  if (trace::enabled()) {
+    trace_id = trace::current_id() != 0 ? trace::current_id()
+                                        : trace::new_trace_id();
+  }
+
+  trace::TraceScope trace_scope{trace_id};
+  trace::Span span{"client.send_command", "client"};
+
+  tx_.clear();
+  tx_ += "{\"command\":";
+  appendJSONString(tx_, req.name);
+  tx_ += ",\"args\":[";
+
+  for (std::size_t i = 0; i < req.args.size(); i++) {
+    if (i > 0) tx_ += ',';
+
+    tx_ += "{\"name\":";
+    appendJSONString(tx_, req.args[i].name);
+    tx_ += ",\"value\":";
+    appendJSONString(tx_, req.args[i].value);
+    tx_ += '}';
+  }
+
+  tx_ += "]}";
 
-  command["command"] = req.name;
+  return sendPayload(service);
+}
 
-  json args = json::array();
+bool Client::impl::send(std::string_view service,
+                        std::span<const std::string> segments,
+                        std::span<const std::string> values) {
+  std::uint64_t trace_id = 0;
+
+  if (trace::enabled()) {
+    trace_id = trace::current_id() != 0 ? trace::current_id()
+                                        : trace::new_trace_id();
+  }
 
-  for (auto const& arg : req.args) {
-    json a;
+  trace::TraceScope trace_scope{trace_id};
+  trace::Span span{"client.send_prepared", "client"};
 
-    a["name"] = arg.name;
-    a["value"] = arg.value;
+  tx_.clear();
 
-    args.push_back(a);
+  for (std::size_t i = 0; i < values.size(); i++) {
+    tx_ += segments[i];
+    appendJSONString(tx_, values[i]);
   }
 
-  command["args"] = args;
+  tx_ += segments.back();
 
-  std::string payload = command.dump();
+  return sendPayload(service);
+}
+
+/* Sends tx_ as a JSON command, tagged with the calling thread's trace ID */
+bool Client::impl::sendPayload(std::string_view service) {
+  auto seq = seq_.find(service);
 
-  CommandMsgHeader header = {.version = 1, .proto = MessageProtocol::JSON};
+  if (seq == seq_.end()) seq = seq_.emplace(service, 0U).first;
+
+  CommandMsgHeader header = {
+      .version = header_version_,
+      .proto = MessageProtocol::JSON,
+      .sender = sender_id_,
+      .seq = seq->second + 1U,
+      .sendNs = sendClockNs(),
+      .traceId = trace::current_id(),
+  };
 
   if (zmq_send(engine_.pub(), service.data(), service.size(), ZMQ_SNDMORE) <
       0) {
@@ -96,21 +214,24 @@ bool Client::impl::sendCommand(std::string_view service,
     return false;
   }
 
-  std::array<const std::uint8_t, 2> buf = {
-      header.version, static_cast<std::uint8_t>(header.proto)};
+  std::array<std::uint8_t, COMMAND_HEADER_V2_SIZE> buf;
+  std::size_t header_size = encodeHeader(header, buf);
 
-  if (zmq_send(engine_.pub(), buf.data(), buf.size(), ZMQ_SNDMORE) < 0) {
+  if (zmq_send(engine_.pub(), buf.data(), header_size, ZMQ_SNDMORE) < 0) {
     logs::log(ERR, "Failed to send command header! ZMQ error [%s]\n",
               zmq_strerror(errno));
     return false;
   }
 
-  if (zmq_send(engine_.pub(), payload.data(), payload.size(), 0) < 0) {
+  if (zmq_send(engine_.pub(), tx_.data(), tx_.size(), 0) < 0) {
     logs::log(ERR, "Failed to send JSON payload! ZMQ error [%s]\n",
               zmq_strerror(errno));
     return false;
   }
 
+  /* Only count sent commands, so the service sees no gap for failed ones */
+  seq->second++;
+
   return true;
 }
 
@@ -1,14 +1,25 @@
 #include <zmq.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
 #include <cstring>
 #include <fsatutils/errors.hpp>
 #include <fsatutils/log/log.hpp>
+#include <fsatutils/metrics/metrics.hpp>
+#include <fsatutils/trace/trace.hpp>
 #include <fsatutils/zmq/service.hpp>
 #include <fsatutils/zmq/zmq_engine.hpp>
 #include <fsatutils/zmq/zprotocol.hpp>
 #include <fstream>
+#include <memory_resource>
+#include <mutex>
 #include <optional>
 #include <span>
 #include <string>
@@ -21,9 +32,184 @@ namespace fsatutils {
 namespace zmq {
 
 class Service::impl {
+  struct HandlerEntry {
+    CommandHandlerFn fn;
+    void* data;
+    /* What addHandler() hands out to remove it again */
+    std::uint64_t id;
+  };
+
   struct RegistryData {
     std::vector<CommandArg> args;
-    std::vector<std::pair<CommandHandlerFn, void*>> handlers;
+    std::vector<HandlerEntry> handlers;
+    std::vector<TypedHandler> typed;
+    metrics::Histogram* latency;
+    CommandOptions options;
+  };
+
+  struct TopicData {
+    std::string prefix;
+    std::vector<TopicHandlerFn> handlers;
+    CommandOptions options;
+  };
+
+  /*
+   * Immutable set of registered commands. Writers copy the current one,
+   * edit the copy, index it and publish it with an atomic pointer swap; the
+   * dispatch thread reads it without locking. Commands are shared between
+   * snapshots, only the edited one is copied.
+   */
+  struct Registry {
+    static constexpr std::uint32_t EMPTY = ~std::uint32_t{0};
+
+    const RegistryData* find(std::string_view name) const noexcept;
+
+    /* Subscription with the longest prefix of topic */
+    std::shared_ptr<const TopicData> findTopic(std::string_view topic) const;
+
+    /* Finds a seed that maps every name to its own slot */
+    void index();
+
+    static std::uint64_t hash(std::string_view name,
+                              std::uint64_t seed) noexcept;
+
+    std::vector<std::pair<CommandType, std::shared_ptr<const RegistryData>>>
+        commands;
+    std::uint64_t seed = 0;
+    std::vector<std::uint32_t> slots;
+    std::vector<std::shared_ptr<const TopicData>> topics;
+  };
+
+  /* Threads that read the registry, each owns one hazard slot */
+  enum Reader : std::size_t { RECEIVER, DISPATCHER, READERS };
+
+  /* Protects the snapshot a reader thread is using from being freed by a
+   * concurrent writer; a thread holds at most one at a time */
+  class RegistryGuard {
+   public:
+    RegistryGuard(impl& owner, Reader reader) noexcept;
+    ~RegistryGuard() {
+      owner_.hazards_[reader_].store(nullptr, std::memory_order_release);
+    }
+
+    RegistryGuard(const RegistryGuard&) = delete;
+    RegistryGuard& operator=(const RegistryGuard&) = delete;
+
+    Registry const& operator*() const noexcept { return *registry_; }
+
+   private:
+    impl& owner_;
+    Reader reader_;
+    const Registry* registry_;
+  };
+
+  /* Sequence and latency tracking for a v2 sender */
+  struct SenderData {
+    std::uint64_t received = 0;
+    std::uint64_t lost = 0;
+    std::uint64_t late = 0;
+    std::uint64_t lastSeq = 0;
+    std::uint64_t lastSeenNs = 0;
+    metrics::LocalHistogram latency;
+  };
+
+  /* Slots beyond the ingress capacity, the one being received into and the
+   * one being dispatched */
+  static constexpr std::size_t EXTRA_SLOTS = 2U;
+
+  /* Backs a slot's decoded Command, spills to the heap if a message ever
+   * needs more */
+  static constexpr std::size_t SLOT_ARENA_BYTES = 4096U;
+
+  /* How often the receiver checks for a stop request */
+  static constexpr int RECV_TIMEOUT_MS = 100;
+
+  static constexpr std::size_t PRIORITY_CLASSES = 4U;
+
+  /* A received message waiting for the dispatch thread. The decoded Command
+   * points into buf and arena, so slots are pooled and reused rather than
+   * allocated per message */
+  struct Pending {
+    std::array<std::uint8_t, ZMQ_FLATSAT_ENGINE_MTU> buf;
+    std::array<std::byte, SLOT_ARENA_BYTES> arenaBuf;
+    std::pmr::monotonic_buffer_resource arena{arenaBuf.data(),
+                                              arenaBuf.size()};
+    std::optional<Command> command;
+    bool discover = false;
+    /* Set for messages on a subscribed topic, data follows the topic in
+     * buf */
+    std::shared_ptr<const TopicData> topic;
+    std::span<const std::uint8_t> data;
+    /* Command name or topic, what conflation matches on */
+    std::string_view key;
+    std::size_t priority = 0;
+    std::uint64_t receivedNs = 0;
+    /* Absolute, 0 when the command has none */
+    std::uint64_t deadlineNs = 0;
+    bool dropLate = false;
+    bool conflate = false;
+
+    void setOptions(CommandOptions const& options) noexcept;
+  };
+
+  /* FIFO of one priority class, sized to hold the whole ingress queue */
+  struct Queue {
+    void push(Pending* p) noexcept {
+      items[(head + size++) % items.size()] = p;
+    }
+
+    Pending* pop() noexcept {
+      Pending* p = items[head];
+
+      head = (head + 1U) % items.size();
+      size--;
+
+      return p;
+    }
+
+    Pending** find(std::string_view key) noexcept {
+      for (std::size_t i = 0; i < size; i++) {
+        Pending*& p = items[(head + i) % items.size()];
+
+        if (p->key == key) return &p;
+      }
+
+      return nullptr;
+    }
+
+    std::vector<Pending*> items;
+    std::size_t head = 0;
+    std::size_t size = 0;
+  };
+
+  /* Least recently seen senders are forgotten beyond this, e.g. one-shot CLI
+   * clients */
+  static constexpr std::size_t MAX_SENDERS = 64U;
+
+  struct ClassMetrics {
+    metrics::Gauge& depth;
+    metrics::Counter& deadlineMissed;
+    metrics::Histogram& waitNs;
+  };
+
+  struct Metrics {
+    metrics::Counter& received;
+    metrics::Counter& recvErrors;
+    metrics::Counter& parseFailures;
+    metrics::Counter& unknownCommands;
+    metrics::Counter& invalidArgs;
+    metrics::Counter& commands;
+    metrics::Counter& discovers;
+    metrics::Counter& topicMessages;
+    metrics::Counter& droppedOldest;
+    metrics::Counter& droppedNewest;
+    metrics::Counter& conflated;
+    metrics::Counter& legacyHeaders;
+    metrics::Counter& lost;
+    metrics::Counter& late;
+    metrics::Histogram& handlerNs;
+    metrics::Histogram& onewayNs;
+    std::array<ClassMetrics, PRIORITY_CLASSES> classes;
   };
 
  public:
@@ -36,32 +222,111 @@ class Service::impl {
 
   bool registerCommand(CommandType command, std::vector<CommandArg> args,
                        std::optional<CommandHandlerFn> handler,
-                       std::optional<void*> handlerData);
+                       std::optional<void*> handlerData,
+                       CommandOptions options);
+
+  HandlerHandle addHandler(CommandType& command,
+                           Service::CommandHandlerFn handler,
+                           void* handlerData);
 
-  bool registerHandler(CommandType& command, Service::CommandHandlerFn handler,
-                       void* handlerData);
+  bool unregisterHandler(HandlerHandle const& handle);
 
-  void workTask(std::stop_token token);
+  bool registerTyped(CommandType command, std::vector<CommandArg> args,
+                     TypedHandler handler, CommandOptions options);
+
+  bool unregisterCommand(std::string_view command);
+
+  void receiveTask(std::stop_token token);
+  void dispatchTask(std::stop_token token);
 
   bool subscribeTo(std::string_view topic);
+  bool subscribeTo(std::string_view topic, TopicHandlerFn handler,
+                   CommandOptions options);
 
   bool publishRawBytes(std::string_view topic, std::span<std::uint8_t> data);
 
+  void publishStats(std::chrono::milliseconds interval);
+
+  void setIngress(IngressOptions options);
+
+  std::vector<Service::SenderStats> senderStats() const;
+
+  metrics::Registry& metrics() { return metrics_registry_; }
+
  private:
-  std::variant<std::monostate, Command, DiscoverMsgHeader, std::string>
+  struct TopicMessage {
+    std::string_view topic;
+    std::span<const std::uint8_t> data;
+  };
+
+  std::variant<std::monostate, Command, DiscoverMsgHeader, TopicMessage>
   parseMessage(std::span<std::uint8_t, ZMQ_FLATSAT_ENGINE_MTU> buf,
-               std::span<uint8_t> topic, int more, std::size_t more_size);
+               std::pmr::memory_resource* mr, std::span<uint8_t> topic,
+               int more, std::size_t more_size);
+
+  bool receive(Pending& slot);
+  void dispatch(Pending& slot);
+
+  void drainFrames();
+  void applySubscriptions();
+
+  void allocateSlots();
+  Pending* acquireSlot(std::stop_token const& stoken);
+  void releaseSlot(Pending* slot);
+  void enqueue(Pending* slot, std::stop_token const& stoken);
+  Pending* dequeue();
+  Pending* evictOldest(std::size_t priority);
+  void updateDepth(std::size_t priority);
+
+  bool runCommandHandler(Registry const& registry, Command const& cmd);
+
+  void trackSender(CommandMsgHeader const& header);
 
-  bool runCommandHandler(Command cmd);
+  std::vector<char> serializeServiceDescription(Registry const& registry);
 
-  std::vector<char> serializeServiceDescription();
+  template <typename Edit>
+  bool updateRegistry(Edit&& edit);
 
   bool connectToEngineProxy();
 
+  void publishStatsSnapshot();
+
+  Metrics makeMetrics();
+  static ClassMetrics classMetrics(metrics::Registry& reg, Priority p);
+
   ServiceDescription desc_;
   ZMQEngine engine_;
-  std::unordered_map<CommandType, RegistryData> command_registry_;
-  std::jthread work_thread_;
+  /* Serializes sends, publishRawBytes() may be called from any thread */
+  std::mutex pub_mtx_;
+  /* Subscriptions made while the receiver owns the SUB socket, which it
+   * applies itself */
+  std::mutex subs_mtx_;
+  std::vector<std::string> subs_;
+  bool receiving_ = false;
+  std::mutex registry_mtx_;
+  /* Guarded by registry_mtx_ */
+  std::uint64_t next_handler_id_ = 1;
+  std::unique_ptr<const Registry> registry_owner_;
+  std::atomic<const Registry*> registry_;
+  std::array<std::atomic<const Registry*>, READERS> hazards_ = {};
+  std::vector<std::unique_ptr<const Registry>> retired_;
+  /* Per instance, so services sharing a process keep their own numbers */
+  metrics::Registry metrics_registry_;
+  Metrics metrics_;
+  std::chrono::milliseconds stats_interval_{0};
+  std::chrono::steady_clock::time_point last_stats_;
+  mutable std::mutex senders_mtx_;
+  std::unordered_map<std::uint64_t, std::unique_ptr<SenderData>> senders_;
+  IngressOptions ingress_;
+  std::vector<std::unique_ptr<Pending>> slots_;
+  std::mutex queue_mtx_;
+  std::condition_variable_any queued_cv_;
+  std::condition_variable_any free_cv_;
+  std::vector<Pending*> free_;
+  std::array<Queue, PRIORITY_CLASSES> queues_;
+  std::size_t queued_ = 0;
+  std::jthread recv_thread_;
+  std::jthread dispatch_thread_;
 };
 
 Service::Service(ServiceDescription desc)
@@ -76,8 +341,9 @@ void Service::stopService() { impl_->stopService(); }
 Service& Service::registerCommand(CommandType command,
                                   std::vector<CommandArg> args,
                                   std::optional<CommandHandlerFn> handler,
-                                  std::optional<void*> handlerData) {
-  if (!impl_->registerCommand(command, args, handler, handlerData)) {
+                                  std::optional<void*> handlerData,
+                                  CommandOptions options) {
+  if (!impl_->registerCommand(command, args, handler, handlerData, options)) {
     logs::log(ERR, "Failed to register command [%s]\n", command.c_str());
   }
 
@@ -87,22 +353,131 @@ Service& Service::registerCommand(CommandType command,
 bool Service::registerHandler(CommandType& command,
                               Service::CommandHandlerFn handler,
                               void* handlerData) {
-  return impl_->registerHandler(command, handler, handlerData);
+  return static_cast<bool>(impl_->addHandler(command, handler, handlerData));
+}
+
+Service::HandlerHandle Service::addHandler(CommandType& command,
+                                           Service::CommandHandlerFn handler,
+                                           void* handlerData) {
+  return impl_->addHandler(command, handler, handlerData);
+}
+
+bool Service::unregisterHandler(HandlerHandle const& handle) {
+  return impl_->unregisterHandler(handle);
+}
+
+bool Service::unregisterCommand(std::string_view command) {
+  return impl_->unregisterCommand(command);
+}
+
+Service& Service::registerTyped(CommandType command,
+                                std::vector<CommandArg> args,
+                                TypedHandler handler, CommandOptions options) {
+  if (!impl_->registerTyped(command, std::move(args), std::move(handler),
+                            options)) {
+    logs::log(ERR, "Failed to register command [%s]\n", command.c_str());
+  }
+
+  return *this;
 }
 
 bool Service::subscribeTo(std::string_view topic) {
   return impl_->subscribeTo(topic);
 }
 
+bool Service::subscribeTo(std::string_view topic, TopicHandlerFn handler,
+                          CommandOptions options) {
+  return impl_->subscribeTo(topic, std::move(handler), options);
+}
+
 bool Service::publishRawBytes(std::string_view topic,
                               std::span<std::uint8_t> data) {
   return impl_->publishRawBytes(topic, data);
 }
 
-Service::impl::impl(ServiceDescription desc) : desc_{std::move(desc)} {
+void Service::publishStats(std::chrono::milliseconds interval) {
+  impl_->publishStats(interval);
+}
+
+void Service::setIngress(IngressOptions options) {
+  impl_->setIngress(options);
+}
+
+std::vector<Service::SenderStats> Service::senderStats() const {
+  return impl_->senderStats();
+}
+
+metrics::Registry& Service::metrics() { return impl_->metrics(); }
+
+Service::impl::impl(ServiceDescription desc)
+    : desc_{std::move(desc)},
+      registry_owner_{std::make_unique<Registry>()},
+      registry_{registry_owner_.get()},
+      metrics_{makeMetrics()} {
   if (!connectToEngineProxy()) {
     throw_runtime_error("Failed to connect to FlatSat2 ZMQ Engine!");
   }
+
+  registerCommand(
+      std::string{g_statsCommand}, {},
+      [this](void*, Command const&) { publishStatsSnapshot(); }, std::nullopt,
+      {});
+}
+
+namespace {
+
+constexpr std::string_view priorityToString(Priority p) {
+  switch (p) {
+    case Priority::CRITICAL:
+      return "critical";
+    case Priority::HIGH:
+      return "high";
+    case Priority::NORMAL:
+      return "normal";
+    case Priority::LOW:
+      return "low";
+  }
+  return "unknown";
+}
+
+}  // namespace
+
+Service::impl::ClassMetrics Service::impl::classMetrics(
+    metrics::Registry& reg, Priority p) {
+  std::string cls{priorityToString(p)};
+
+  return {
+      .depth = reg.gauge("service.queue_depth." + cls),
+      .deadlineMissed = reg.counter("service.deadline_missed." + cls),
+      .waitNs = reg.histogram("service.queue_wait_ns." + cls),
+  };
+}
+
+Service::impl::Metrics Service::impl::makeMetrics() {
+  auto& reg = metrics_registry_;
+
+  return {
+      .received = reg.counter("service.messages_received"),
+      .recvErrors = reg.counter("service.recv_errors"),
+      .parseFailures = reg.counter("service.parse_failures"),
+      .unknownCommands = reg.counter("service.unknown_commands"),
+      .invalidArgs = reg.counter("service.invalid_args"),
+      .commands = reg.counter("service.commands"),
+      .discovers = reg.counter("service.discover_requests"),
+      .topicMessages = reg.counter("service.topic_messages"),
+      .droppedOldest = reg.counter("service.ingress_dropped_oldest"),
+      .droppedNewest = reg.counter("service.ingress_dropped_newest"),
+      .conflated = reg.counter("service.ingress_conflated"),
+      .legacyHeaders = reg.counter("service.v1_headers"),
+      .lost = reg.counter("service.commands_lost"),
+      .late = reg.counter("service.commands_late"),
+      .handlerNs = reg.histogram("service.handler_ns"),
+      .onewayNs = reg.histogram("service.oneway_ns"),
+      .classes = {classMetrics(reg, Priority::CRITICAL),
+                  classMetrics(reg, Priority::HIGH),
+                  classMetrics(reg, Priority::NORMAL),
+                  classMetrics(reg, Priority::LOW)},
+  };
 }
 
 void Service::impl::runService() {
@@ -115,88 +490,441 @@ void Service::impl::runService() {
   ofs << pid;
   ofs.close();
 
-  work_thread_ =
-      std::jthread{[this](std::stop_token stoken) { this->workTask(stoken); }};
+  /* Lets the receiver notice stop requests */
+  int timeout = RECV_TIMEOUT_MS;
+
+  zmq_setsockopt(engine_.sub(), ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
+  last_stats_ = std::chrono::steady_clock::now();
+
+  allocateSlots();
+
+  {
+    std::lock_guard<std::mutex> lock{subs_mtx_};
+    receiving_ = true;
+  }
+
+  dispatch_thread_ = std::jthread{
+      [this](std::stop_token stoken) { this->dispatchTask(stoken); }};
+  recv_thread_ = std::jthread{
+      [this](std::stop_token stoken) { this->receiveTask(stoken); }};
 }
 
 void Service::impl::stopService() {
-  work_thread_.request_stop();
+  recv_thread_.request_stop();
+  dispatch_thread_.request_stop();
+
+  if (recv_thread_.joinable()) {
+    recv_thread_.join();
+  }
 
-  if (work_thread_.joinable()) {
-    work_thread_.join();
+  {
+    std::lock_guard<std::mutex> lock{subs_mtx_};
+    receiving_ = false;
+  }
+
+  /* Anything subscribed to after the receiver's last pass */
+  applySubscriptions();
+
+  if (dispatch_thread_.joinable()) {
+    dispatch_thread_.join();
   }
 }
 
 void Service::impl::cleanResources() { stopService(); }
 
-void Service::impl::workTask(std::stop_token stoken) {
+/*
+ * Receives and decodes messages into free slots and queues them by priority.
+ * ZMQ sockets are not thread safe: this thread is the only one touching the
+ * SUB socket while it runs, and sends on the PUB socket hold pub_mtx_.
+ */
+void Service::impl::receiveTask(std::stop_token stoken) {
+  Pending* slot = nullptr;
+
   while (!stoken.stop_requested()) {
-    std::array<std::uint8_t, ZMQ_FLATSAT_ENGINE_MTU> buf;
-    int more = 0;
-    std::size_t more_size = sizeof(more);
+    applySubscriptions();
 
-    int res = zmq_recv(engine_.sub(), buf.data(), buf.size(), 0);
+    if (slot == nullptr && (slot = acquireSlot(stoken)) == nullptr) break;
 
-    if (res < 0) {
-      logs::log(ERR, "Error recv data [%s]\n", zmq_strerror(zmq_errno()));
-      continue;
+    if (receive(*slot)) {
+      enqueue(slot, stoken);
+      slot = nullptr;
     }
+  }
 
-    zmq_getsockopt(engine_.sub(), ZMQ_RCVMORE, &more, &more_size);
+  if (slot != nullptr) releaseSlot(slot);
+}
+
+void Service::impl::dispatchTask(std::stop_token stoken) {
+  using clock = std::chrono::steady_clock;
+
+  while (!stoken.stop_requested()) {
+    Pending* slot = nullptr;
+
+    {
+      std::unique_lock<std::mutex> lock{queue_mtx_};
+      auto ready = [this] { return queued_ > 0; };
+
+      if (stats_interval_.count() > 0) {
+        queued_cv_.wait_until(lock, stoken, last_stats_ + stats_interval_,
+                              ready);
+      } else {
+        queued_cv_.wait(lock, stoken, ready);
+      }
+
+      slot = dequeue();
+    }
+
+    /* Lets a receiver blocked on a full queue carry on meanwhile */
+    if (slot != nullptr) free_cv_.notify_one();
+
+    if (stats_interval_.count() > 0 &&
+        clock::now() - last_stats_ >= stats_interval_) {
+      publishStatsSnapshot();
+      last_stats_ = clock::now();
+    }
+
+    if (slot == nullptr) continue;
+
+    dispatch(*slot);
+    releaseSlot(slot);
+  }
+}
+
+/* Fills slot with the next message, false if there is nothing to queue */
+bool Service::impl::receive(Pending& slot) {
+  int more = 0;
+  std::size_t more_size = sizeof(more);
+
+  slot.command.reset();
+  slot.discover = false;
+  slot.topic.reset();
+  slot.key = {};
+  slot.arena.release();
+
+  int res = zmq_recv(engine_.sub(), slot.buf.data(), slot.buf.size(), 0);
+
+  if (res < 0) {
+    if (zmq_errno() == EAGAIN) return false;
+
+    metrics_.recvErrors.add();
+    logs::log(ERR, "Error recv data [%s]\n", zmq_strerror(zmq_errno()));
+    return false;
+  }
+
+  metrics_.received.add();
+  slot.receivedNs = sendClockNs();
+
+  /* The trace ID is only known once the payload is parsed, the message
+   * span picks it up when it ends */
+  trace::TraceScope trace_scope{0};
+  trace::Span span{"service.receive", "service"};
+
+  zmq_getsockopt(engine_.sub(), ZMQ_RCVMORE, &more, &more_size);
+
+  if (!more) {
+    metrics_.parseFailures.add();
+    logs::log(ERR, "Message is not multipart!\n");
+    return false;
+  }
+
+  /* ZMQ reports the full length of truncated frames */
+  auto len = std::min(static_cast<std::size_t>(res), slot.buf.size());
+  std::span<uint8_t> m{slot.buf.data(), len};
+
+  auto request = parseMessage(slot.buf, &slot.arena, m, more, more_size);
+
+  /* Whichever way parsing went, leave the socket at a message boundary so
+   * the next frame read is a topic */
+  drainFrames();
+
+  if (std::holds_alternative<std::monostate>(request)) {
+    metrics_.parseFailures.add();
+    logs::log(ERR, "Failed to parse message!");
+    return false;
+  }
+
+  if (std::holds_alternative<DiscoverMsgHeader>(request)) {
+    slot.discover = true;
+    slot.setOptions({});
+
+    return true;
+  }
+
+  RegistryGuard registry{*this, RECEIVER};
+
+  if (auto* msg = std::get_if<TopicMessage>(&request)) {
+    slot.topic = (*registry).findTopic(msg->topic);
 
-    if (!more) {
-      logs::log(ERR, "Message is not multipart!\n");
-      continue;
+    /* Subscribed to without a handler */
+    if (slot.topic == nullptr) return false;
+
+    metrics_.topicMessages.add();
+    slot.key = msg->topic;
+    slot.data = msg->data;
+    slot.setOptions(slot.topic->options);
+
+    return true;
+  }
+
+  auto& command =
+      slot.command.emplace(std::move(std::get<Command>(request)));
+  const RegistryData* data = (*registry).find(command.cmd);
+
+  trace_scope.set(command.traceId);
+
+  if (data == nullptr) {
+    metrics_.unknownCommands.add();
+    logs::log(ERR, "Service does not suppport command [%.*s]!\n",
+              static_cast<int>(command.cmd.size()), command.cmd.data());
+    return false;
+  }
+
+  slot.key = command.cmd;
+  slot.setOptions(data->options);
+
+  return true;
+}
+
+void Service::impl::Pending::setOptions(
+    CommandOptions const& options) noexcept {
+  priority = static_cast<std::size_t>(options.priority);
+  dropLate = options.dropLate;
+  conflate = options.conflate;
+  deadlineNs = 0;
+
+  if (options.deadline.has_value()) {
+    auto ns = std::chrono::nanoseconds{*options.deadline};
+
+    deadlineNs = receivedNs + static_cast<std::uint64_t>(ns.count());
+  }
+}
+
+void Service::impl::dispatch(Pending& slot) {
+  std::uint64_t now = sendClockNs();
+  auto& cls = metrics_.classes[slot.priority];
+
+  cls.waitNs.record(now - slot.receivedNs);
+
+  if (slot.discover) {
+    metrics_.discovers.add();
+    logs::log(INFO, "Discover request received! Sending service details...");
+
+    std::vector<char> res;
+
+    {
+      RegistryGuard registry{*this, DISPATCHER};
+      res = serializeServiceDescription(*registry);
     }
 
-    std::span<uint8_t> m{buf.data(), static_cast<std::size_t>(res)};
+    std::lock_guard<std::mutex> lock{pub_mtx_};
 
-    auto request = parseMessage(buf, m, more, more_size);
+    if (zmq_send(engine_.pub(), "beacon", 6U, ZMQ_SNDMORE) < 0) {
+      logs::log(ERR,
+                "Failed to send beacon topic as response to discover request!");
+    }
 
-    if (std::holds_alternative<std::monostate>(request)) {
-      logs::log(ERR, "Failed to parse message!");
-      continue;
+    if (zmq_send(engine_.pub(), res.data(), res.size(), 0U) < 0) {
+      logs::log(
+          ERR, "Failed to send service data as response to discover request!");
     }
 
-    if (std::holds_alternative<DiscoverMsgHeader>(request)) {
-      logs::log(INFO, "Discover request received! Sending service details...");
+    return;
+  }
 
-      auto res = serializeServiceDescription();
+  std::uint64_t trace_id = slot.command ? slot.command->traceId : 0U;
+  trace::TraceScope trace_scope{trace_id};
 
-      if (zmq_send(engine_.pub(), "beacon", 6U, ZMQ_SNDMORE) < 0) {
-        logs::log(
-            ERR,
-            "Failed to send beacon topic as response to discover request!");
-      }
+  if (trace::enabled()) {
+    trace::record({"service.queued", "service", slot.receivedNs,
+                   now - slot.receivedNs, trace_id});
+  }
 
-      if (zmq_send(engine_.pub(), res.data(), res.size(), 0U) < 0) {
-        logs::log(
-            ERR,
-            "Failed to send service data as response to discover request!");
-      }
+  if (slot.deadlineNs != 0U && now > slot.deadlineNs) {
+    cls.deadlineMissed.add();
+    logs::log(WARN, "%s [%.*s] missed its deadline by %llu us%s\n",
+              slot.topic != nullptr ? "Topic" : "Command",
+              static_cast<int>(slot.key.size()), slot.key.data(),
+              static_cast<unsigned long long>((now - slot.deadlineNs) / 1000U),
+              slot.dropLate ? ", dropped" : "");
+
+    if (slot.dropLate) return;
+  }
+
+  trace::Span span{"service.dispatch", "service"};
+
+  if (slot.topic != nullptr) {
+    for (auto const& handler : slot.topic->handlers) {
+      handler(slot.key, slot.data);
     }
 
-    if (std::holds_alternative<Command>(request)) {
-      auto command = std::get<Command>(request);
+    return;
+  }
 
-      if (!runCommandHandler(command)) {
-        logs::log(ERR, "Failed to run command handler!");
-      }
+  RegistryGuard registry{*this, DISPATCHER};
+
+  if (!runCommandHandler(*registry, *slot.command)) {
+    logs::log(ERR, "Failed to run command handler!");
+  }
+}
+
+/* Sizes the slot pool and queues to the ingress capacity, dropping anything
+ * left queued by a previous run if it changed */
+void Service::impl::allocateSlots() {
+  std::size_t count = ingress_.capacity + EXTRA_SLOTS;
+
+  if (slots_.size() == count) return;
+
+  slots_.clear();
+  free_.clear();
+  queued_ = 0;
+
+  for (std::size_t c = 0; c < PRIORITY_CLASSES; c++) {
+    queues_[c].items.assign(ingress_.capacity, nullptr);
+    queues_[c].head = 0;
+    queues_[c].size = 0;
+    updateDepth(c);
+  }
+
+  for (std::size_t i = 0; i < count; i++) {
+    slots_.push_back(std::make_unique<Pending>());
+    free_.push_back(slots_.back().get());
+  }
+}
+
+Service::impl::Pending* Service::impl::acquireSlot(
+    std::stop_token const& stoken) {
+  std::unique_lock<std::mutex> lock{queue_mtx_};
+
+  if (!free_cv_.wait(lock, stoken, [this] { return !free_.empty(); })) {
+    return nullptr;
+  }
+
+  Pending* slot = free_.back();
+
+  free_.pop_back();
+
+  return slot;
+}
+
+void Service::impl::releaseSlot(Pending* slot) {
+  slot->topic.reset();
+
+  {
+    std::lock_guard<std::mutex> lock{queue_mtx_};
+    free_.push_back(slot);
+  }
+
+  free_cv_.notify_one();
+}
+
+/* Queues slot under the ingress policy, or returns it to the pool if it was
+ * dropped */
+void Service::impl::enqueue(Pending* slot, std::stop_token const& stoken) {
+  std::unique_lock<std::mutex> lock{queue_mtx_};
+  Queue& q = queues_[slot->priority];
+
+  if (slot->conflate) {
+    if (Pending** queued = q.find(slot->key); queued != nullptr) {
+      /* Takes over the queued message's place in line */
+      std::swap(*queued, slot);
+      free_.push_back(slot);
+      metrics_.conflated.add();
+      return;
     }
   }
+
+  if (queued_ >= ingress_.capacity) {
+    Pending* dropped = nullptr;
+
+    switch (ingress_.overflow) {
+      case Overflow::BLOCK:
+        if (!free_cv_.wait(lock, stoken, [this] {
+              return queued_ < ingress_.capacity;
+            })) {
+          dropped = slot;
+        }
+        break;
+      case Overflow::DROP_OLDEST:
+        dropped = evictOldest(slot->priority);
+
+        if (dropped != nullptr) {
+          metrics_.droppedOldest.add();
+          break;
+        }
+
+        [[fallthrough]];
+      case Overflow::DROP_NEWEST:
+        dropped = slot;
+        metrics_.droppedNewest.add();
+        break;
+    }
+
+    if (dropped != nullptr) {
+      logs::log(DEBUG, "Ingress queue full, dropped [%.*s]\n",
+                static_cast<int>(dropped->key.size()), dropped->key.data());
+      dropped->topic.reset();
+      free_.push_back(dropped);
+    }
+
+    if (dropped == slot) return;
+  }
+
+  q.push(slot);
+  queued_++;
+  updateDepth(slot->priority);
+  lock.unlock();
+
+  queued_cv_.notify_one();
 }
 
-std::variant<std::monostate, Command, DiscoverMsgHeader, std::string>
-Service::impl::parseMessage(std::span<std::uint8_t, ZMQ_FLATSAT_ENGINE_MTU> buf,
-                            std::span<uint8_t> topic, int more,
-                            std::size_t more_size) {
-  auto min_size = std::min(g_discoverTopic.size(), desc_.name.size());
+/* Highest class first, FIFO within a class; called with queue_mtx_ held */
+Service::impl::Pending* Service::impl::dequeue() {
+  for (std::size_t c = 0; c < PRIORITY_CLASSES; c++) {
+    Queue& q = queues_[c];
 
-  if (topic.size() < min_size) {
-    logs::log(ERR, "Message was too short to be parsed!");
-    return std::monostate{};
+    if (q.size == 0) continue;
+
+    Pending* slot = q.pop();
+
+    queued_--;
+    updateDepth(c);
+
+    return slot;
+  }
+
+  return nullptr;
+}
+
+/* Oldest message of the lowest class queued, unless that class is above
+ * priority; called with queue_mtx_ held */
+Service::impl::Pending* Service::impl::evictOldest(std::size_t priority) {
+  for (std::size_t c = PRIORITY_CLASSES; c-- > priority;) {
+    Queue& q = queues_[c];
+
+    if (q.size == 0) continue;
+
+    Pending* slot = q.pop();
+
+    queued_--;
+    updateDepth(c);
+
+    return slot;
   }
 
+  return nullptr;
+}
+
+void Service::impl::updateDepth(std::size_t priority) {
+  metrics_.classes[priority].depth.set(
+      static_cast<std::int64_t>(queues_[priority].size));
+}
+
+std::variant<std::monostate, Command, DiscoverMsgHeader,
+             Service::impl::TopicMessage>
+Service::impl::parseMessage(std::span<std::uint8_t, ZMQ_FLATSAT_ENGINE_MTU> buf,
+                            std::pmr::memory_resource* mr,
+                            std::span<uint8_t> topic, int more,
+                            std::size_t more_size) {
   if (topic.size() == g_discoverTopic.size()) {
     /* Check the subscribed topic of the message */
 
@@ -213,32 +941,53 @@ Service::impl::parseMessage(std::span<std::uint8_t, ZMQ_FLATSAT_ENGINE_MTU> buf,
     }
   }
 
-  std::string t{reinterpret_cast<char*>(topic.data()), topic.size()};
+  std::string_view name{reinterpret_cast<char*>(topic.data()), topic.size()};
+
+  /* Anything not addressed to the service is on a subscribed topic; its
+   * data goes right after the topic in buf */
+  if (name != desc_.name) {
+    auto data = buf.subspan(topic.size());
+    int res = zmq_recv(engine_.sub(), data.data(), data.size(), 0);
+
+    if (res < 0) {
+      logs::log(ERR, "Error recv topic data [%s]\n",
+                zmq_strerror(zmq_errno()));
+      return std::monostate{};
+    }
 
-  /* Check if the subscribed topic of the message is the service name */
-  if (!std::equal(topic.begin(), topic.end(), desc_.name.begin())) {
-    return t;
+    return TopicMessage{
+        .topic = name,
+        .data = data.first(std::min(static_cast<std::size_t>(res),
+                                    data.size())),
+    };
   }
 
-  logs::log(DEBUG, "Received a command for service [%s]!\n", t.c_str());
+  logs::log(DEBUG, "Received a command for service [%.*s]!\n",
+            static_cast<int>(topic.size()),
+            reinterpret_cast<char*>(topic.data()));
 
+  std::optional<trace::Span> recv_span{std::in_place, "service.recv_frames",
+                                       "service"};
   int res = zmq_recv(engine_.sub(), buf.data(), buf.size(), 0);
 
   if (res < 0) {
     logs::log(ERR, "Error recv command header [%s]\n",
               zmq_strerror(zmq_errno()));
     return std::monostate{};
-  } else if (res != 2) {
-    logs::log(ERR, "Command header must be 2 bytes\n");
+  }
+
+  /* zmq_recv reports the full frame length even when it was truncated */
+  auto decoded = decodeHeader(
+      {buf.data(), std::min(static_cast<std::size_t>(res), buf.size())});
+
+  if (!decoded.has_value()) {
+    logs::log(ERR, "Invalid command header of %d bytes\n", res);
     return std::monostate{};
   }
 
-  std::span<uint8_t> raw_header{buf.data(), 2U};
+  CommandMsgHeader header = decoded.value();
 
-  CommandMsgHeader header = {
-      .version = raw_header[0],
-      .proto = static_cast<MessageProtocol>(raw_header[1]),
-  };
+  trackSender(header);
 
   zmq_getsockopt(engine_.sub(), ZMQ_RCVMORE, &more, &more_size);
 
@@ -255,16 +1004,26 @@ Service::impl::parseMessage(std::span<std::uint8_t, ZMQ_FLATSAT_ENGINE_MTU> buf,
     return std::monostate{};
   }
 
+  if (static_cast<std::size_t>(res) > buf.size()) {
+    logs::log(ERR, "Dropping command payload of %d bytes, over the MTU\n",
+              res);
+    return std::monostate{};
+  }
+
   std::span<const uint8_t> payload{buf.data(), static_cast<std::size_t>(res)};
 
+  recv_span.reset();
+
   switch (header.proto) {
     case MessageProtocol::BINARY: {
       return std::monostate{};
     }
     case MessageProtocol::JSON: {
-      auto parsed_cmd = parseJSON(payload);
+      trace::Span parse_span{"service.parse_json", "service"};
+      auto parsed_cmd = parseJSON(payload, mr);
       if (parsed_cmd.has_value()) {
-        return parsed_cmd.value();
+        parsed_cmd->traceId = header.traceId;
+        return std::move(parsed_cmd.value());
       } else {
         return std::monostate{};
       }
@@ -277,25 +1036,136 @@ Service::impl::parseMessage(std::span<std::uint8_t, ZMQ_FLATSAT_ENGINE_MTU> buf,
   }
 }
 
-bool Service::impl::runCommandHandler(Command cmd) {
-  if (!command_registry_.contains(cmd.cmd)) {
-    logs::log(ERR, "Service does not suppport command [%s]!\n",
-              cmd.cmd.c_str());
+bool Service::impl::runCommandHandler(Registry const& registry,
+                                      Command const& cmd) {
+  std::optional<trace::Span> lookup_span{std::in_place, "service.lookup",
+                                         "service"};
+  const RegistryData* data = registry.find(cmd.cmd);
+
+  if (data == nullptr) {
+    metrics_.unknownCommands.add();
+    logs::log(ERR, "Service does not suppport command [%.*s]!\n",
+              static_cast<int>(cmd.cmd.size()), cmd.cmd.data());
     return false;
   }
 
-  auto& cmdData = command_registry_[cmd.cmd];
+  auto& cmdData = *data;
+  auto start = std::chrono::steady_clock::now();
+  bool ok = true;
+
+  lookup_span.reset();
+  metrics_.commands.add();
 
-  for (auto& handler : cmdData.handlers) {
-    if (handler.first != nullptr) {
-      handler.first(handler.second, cmd);
+  {
+    trace::Span handler_span{"service.handler", "service"};
+
+    for (auto& handler : cmdData.handlers) {
+      if (handler.fn != nullptr) {
+        handler.fn(handler.data, cmd);
+      }
+    }
+
+    for (auto& handler : cmdData.typed) {
+      std::string_view bad;
+
+      if (!handler.invoke(handler.callable.get(), cmd, bad)) {
+        metrics_.invalidArgs.add();
+        logs::log(ERR,
+                  "Missing or invalid argument [%.*s] for command [%.*s]\n",
+                  static_cast<int>(bad.size()), bad.data(),
+                  static_cast<int>(cmd.cmd.size()), cmd.cmd.data());
+        ok = false;
+      }
     }
   }
 
-  return true;
+  auto ns = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count());
+
+  metrics_.handlerNs.record(ns);
+  cmdData.latency->record(ns);
+
+  return ok;
 }
 
-std::vector<char> Service::impl::serializeServiceDescription() {
+void Service::impl::trackSender(CommandMsgHeader const& header) {
+  if (header.version < 2U) {
+    metrics_.legacyHeaders.add();
+    return;
+  }
+
+  std::uint64_t now = sendClockNs();
+  std::lock_guard<std::mutex> lock{senders_mtx_};
+  auto it = senders_.find(header.sender);
+
+  if (it == senders_.end()) {
+    if (senders_.size() >= MAX_SENDERS) {
+      senders_.erase(std::min_element(
+          senders_.begin(), senders_.end(), [](auto const& a, auto const& b) {
+            return a.second->lastSeenNs < b.second->lastSeenNs;
+          }));
+    }
+
+    it = senders_.emplace(header.sender, std::make_unique<SenderData>()).first;
+
+    /* Commands sent before we subscribed are not counted as lost */
+    it->second->lastSeq = header.seq - 1U;
+  }
+
+  SenderData& sender = *it->second;
+
+  sender.received++;
+  sender.lastSeenNs = now;
+
+  if (header.seq > sender.lastSeq) {
+    std::uint64_t lost = header.seq - sender.lastSeq - 1U;
+
+    if (lost > 0U) {
+      sender.lost += lost;
+      metrics_.lost.add(lost);
+      logs::log(WARN, "Lost %llu command(s) from sender %016llx\n",
+                static_cast<unsigned long long>(lost),
+                static_cast<unsigned long long>(header.sender));
+    }
+
+    sender.lastSeq = header.seq;
+  } else {
+    sender.late++;
+    metrics_.late.add();
+  }
+
+  /* Timestamps from another host's clock are meaningless, skip the obvious
+   * ones */
+  if (header.sendNs != 0U && now >= header.sendNs) {
+    sender.latency.record(now - header.sendNs);
+    metrics_.onewayNs.record(now - header.sendNs);
+  }
+}
+
+std::vector<Service::SenderStats> Service::impl::senderStats() const {
+  std::lock_guard<std::mutex> lock{senders_mtx_};
+  std::vector<Service::SenderStats> stats;
+
+  stats.reserve(senders_.size());
+
+  for (auto const& [id, s] : senders_) {
+    stats.push_back({
+        .sender = id,
+        .received = s->received,
+        .lost = s->lost,
+        .late = s->late,
+        .lastSeq = s->lastSeq,
+        .latencyNs = s->latency.snapshot(),
+    });
+  }
+
+  return stats;
+}
+
+std::vector<char> Service::impl::serializeServiceDescription(
+    Registry const& registry) {
   using json = nlohmann::json;
 
   json j;
@@ -307,13 +1177,13 @@ std::vector<char> Service::impl::serializeServiceDescription() {
 
   json cmd_array = json::array();
 
-  for (const auto& cmd : command_registry_) {
+  for (const auto& cmd : registry.commands) {
     json c;
     json arg_array = json::array();
 
     c["name"] = cmd.first;
 
-    for (const auto& arg : cmd.second.args) {
+    for (const auto& arg : cmd.second->args) {
       json a;
 
       a["name"] = arg.name;
@@ -342,50 +1212,371 @@ bool Service::impl::connectToEngineProxy() {
 bool Service::impl::registerCommand(CommandType command,
                                     std::vector<CommandArg> args,
                                     std::optional<CommandHandlerFn> handler,
-                                    std::optional<void*> handlerData) {
+                                    std::optional<void*> handlerData,
+                                    CommandOptions options) {
   void* data = handlerData.value_or(nullptr);
   auto fn = handler.value_or(nullptr);
 
-  if (command_registry_.contains(command)) {
-    if (fn != nullptr) {
-      auto& r = command_registry_[command];
-      r.handlers.push_back({fn, data});
+  return updateRegistry([&](Registry& registry) {
+    for (auto& [name, reg] : registry.commands) {
+      if (name != command) continue;
+
+      if (fn != nullptr) {
+        auto r = std::make_shared<RegistryData>(*reg);
+
+        r->handlers.push_back({fn, data, next_handler_id_++});
+        reg = std::move(r);
+      }
+
+      return true;
     }
 
+    RegistryData first_reg = {
+        .args = std::move(args),
+        .handlers = {{fn, data, next_handler_id_++}},
+        .typed = {},
+        .latency = &metrics_registry_.histogram("service.handler_ns." +
+                                                command),
+        .options = options,
+    };
+
+    registry.commands.emplace_back(
+        command, std::make_shared<RegistryData>(std::move(first_reg)));
+
     return true;
-  }
+  });
+}
 
-  RegistryData first_reg = {
-      .args = args,
-      .handlers = {{fn, data}},
-  };
+Service::HandlerHandle Service::impl::addHandler(
+    CommandType& command, Service::CommandHandlerFn handler,
+    void* handlerData) {
+  HandlerHandle handle{.command = command, .id = 0};
+
+  updateRegistry([&](Registry& registry) {
+    for (auto& [name, reg] : registry.commands) {
+      if (name != command) continue;
+
+      auto r = std::make_shared<RegistryData>(*reg);
+
+      handle.id = next_handler_id_++;
+      r->handlers.push_back({handler, handlerData, handle.id});
+      reg = std::move(r);
+
+      return true;
+    }
 
-  auto res = command_registry_.emplace(command, first_reg);
+    return false;
+  });
 
-  return res.second;
+  return handle;
 }
 
-bool Service::impl::registerHandler(CommandType& command,
-                                    Service::CommandHandlerFn handler,
-                                    void* handlerData) {
-  if (!command_registry_.contains(command)) return false;
+bool Service::impl::unregisterHandler(HandlerHandle const& handle) {
+  return updateRegistry([&](Registry& registry) {
+    for (auto& [name, reg] : registry.commands) {
+      if (name != handle.command) continue;
+
+      auto r = std::make_shared<RegistryData>(*reg);
+
+      if (std::erase_if(r->handlers, [&handle](auto const& h) {
+            return h.id == handle.id;
+          }) == 0U) {
+        return false;
+      }
 
-  auto& reg = command_registry_[command];
+      reg = std::move(r);
 
-  reg.handlers.push_back({handler, handlerData});
+      return true;
+    }
+
+    return false;
+  });
+}
+
+bool Service::impl::registerTyped(CommandType command,
+                                  std::vector<CommandArg> args,
+                                  TypedHandler handler,
+                                  CommandOptions options) {
+  return updateRegistry([&](Registry& registry) {
+    for (auto& [name, reg] : registry.commands) {
+      if (name != command) continue;
+
+      auto r = std::make_shared<RegistryData>(*reg);
+
+      r->typed.push_back(std::move(handler));
+      reg = std::move(r);
+
+      return true;
+    }
+
+    RegistryData first_reg = {
+        .args = std::move(args),
+        .handlers = {},
+        .typed = {std::move(handler)},
+        .latency = &metrics_registry_.histogram("service.handler_ns." +
+                                                command),
+        .options = options,
+    };
+
+    registry.commands.emplace_back(
+        command, std::make_shared<RegistryData>(std::move(first_reg)));
+
+    return true;
+  });
+}
+
+bool Service::impl::unregisterCommand(std::string_view command) {
+  return updateRegistry([&](Registry& registry) {
+    return std::erase_if(registry.commands, [&](auto const& c) {
+             return c.first == command;
+           }) > 0U;
+  });
+}
+
+template <typename Edit>
+bool Service::impl::updateRegistry(Edit&& edit) {
+  std::lock_guard<std::mutex> lock{registry_mtx_};
+  auto next = std::make_unique<Registry>(*registry_owner_);
+
+  if (!edit(*next)) return false;
+
+  next->index();
+
+  registry_.store(next.get(), std::memory_order_seq_cst);
+  retired_.push_back(std::move(registry_owner_));
+  registry_owner_ = std::move(next);
+
+  /* Anything no reader is holding can go, readers only ever load the
+   * snapshot just published from now on */
+  std::array<const Registry*, READERS> in_use;
+
+  for (std::size_t i = 0; i < READERS; i++) {
+    in_use[i] = hazards_[i].load(std::memory_order_seq_cst);
+  }
+
+  std::erase_if(retired_, [&in_use](auto const& r) {
+    return std::find(in_use.begin(), in_use.end(), r.get()) == in_use.end();
+  });
 
   return true;
 }
 
+Service::impl::RegistryGuard::RegistryGuard(impl& owner,
+                                            Reader reader) noexcept
+    : owner_{owner},
+      reader_{reader},
+      registry_{owner.registry_.load(std::memory_order_acquire)} {
+  /* Announce the snapshot, then check it was not retired in between */
+  for (;;) {
+    owner_.hazards_[reader_].store(registry_, std::memory_order_seq_cst);
+
+    const Registry* current = owner_.registry_.load(std::memory_order_seq_cst);
+
+    if (current == registry_) break;
+
+    registry_ = current;
+  }
+}
+
+std::uint64_t Service::impl::Registry::hash(std::string_view name,
+                                            std::uint64_t seed) noexcept {
+  std::uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+
+  for (char c : name) {
+    h ^= static_cast<std::uint8_t>(c);
+    h *= 0x100000001b3ULL;
+  }
+
+  /* FNV alone barely depends on the seed, mix it through */
+  h ^= h >> 33U;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33U;
+
+  return h;
+}
+
+void Service::impl::Registry::index() {
+  slots.clear();
+
+  if (commands.empty()) return;
+
+  std::size_t size = std::bit_ceil(commands.size() * 2U);
+
+  for (std::uint64_t attempt = 1;; attempt++) {
+    /* Sparser tables find a collision-free seed faster */
+    if (attempt % 16U == 0U) size *= 2U;
+
+    slots.assign(size, EMPTY);
+    seed = attempt;
+
+    bool collided = false;
+
+    for (std::uint32_t i = 0; i < commands.size() && !collided; i++) {
+      auto& slot = slots[hash(commands[i].first, seed) & (size - 1U)];
+
+      collided = slot != EMPTY;
+      slot = i;
+    }
+
+    if (!collided) return;
+  }
+}
+
+const Service::impl::RegistryData* Service::impl::Registry::find(
+    std::string_view name) const noexcept {
+  if (slots.empty()) return nullptr;
+
+  std::uint32_t i = slots[hash(name, seed) & (slots.size() - 1U)];
+
+  if (i == EMPTY || commands[i].first != name) return nullptr;
+
+  return commands[i].second.get();
+}
+
+std::shared_ptr<const Service::impl::TopicData>
+Service::impl::Registry::findTopic(std::string_view topic) const {
+  const std::shared_ptr<const TopicData>* best = nullptr;
+
+  for (auto const& t : topics) {
+    if (!topic.starts_with(t->prefix)) continue;
+
+    if (best == nullptr || t->prefix.size() > (*best)->prefix.size()) {
+      best = &t;
+    }
+  }
+
+  return best != nullptr ? *best : nullptr;
+}
+
 bool Service::impl::subscribeTo(std::string_view topic) {
+  std::lock_guard<std::mutex> lock{subs_mtx_};
+
+  if (receiving_) {
+    subs_.emplace_back(topic);
+    return true;
+  }
+
   return (engine_.subscribe_to(topic) == 0) ? true : false;
 }
 
+void Service::impl::applySubscriptions() {
+  std::vector<std::string> subs;
+
+  {
+    std::lock_guard<std::mutex> lock{subs_mtx_};
+    subs.swap(subs_);
+  }
+
+  for (auto const& topic : subs) {
+    if (engine_.subscribe_to(topic) != 0) {
+      logs::log(ERR, "Failed to subscribe to [%s]\n", topic.c_str());
+    }
+  }
+}
+
+void Service::impl::drainFrames() {
+  int more = 0;
+  std::size_t more_size = sizeof(more);
+
+  zmq_getsockopt(engine_.sub(), ZMQ_RCVMORE, &more, &more_size);
+
+  while (more) {
+    /* A null buffer is allowed for a zero length, the frame is discarded */
+    if (zmq_recv(engine_.sub(), nullptr, 0, 0) < 0) break;
+
+    zmq_getsockopt(engine_.sub(), ZMQ_RCVMORE, &more, &more_size);
+  }
+}
+
+bool Service::impl::subscribeTo(std::string_view topic,
+                                TopicHandlerFn handler,
+                                CommandOptions options) {
+  bool added = updateRegistry([&](Registry& registry) {
+    for (auto& t : registry.topics) {
+      if (t->prefix != topic) continue;
+
+      auto r = std::make_shared<TopicData>(*t);
+
+      r->handlers.push_back(std::move(handler));
+      t = std::move(r);
+
+      return true;
+    }
+
+    registry.topics.push_back(std::make_shared<TopicData>(TopicData{
+        .prefix = std::string{topic},
+        .handlers = {std::move(handler)},
+        .options = options,
+    }));
+
+    return true;
+  });
+
+  return added && subscribeTo(topic);
+}
+
 bool Service::impl::publishRawBytes(std::string_view topic,
                                     std::span<std::uint8_t> data) {
+  std::lock_guard<std::mutex> lock{pub_mtx_};
+
   return (engine_.publish_raw_bytes(topic, data) == 0) ? true : false;
 }
 
+void Service::impl::publishStats(std::chrono::milliseconds interval) {
+  stats_interval_ = interval;
+}
+
+void Service::impl::setIngress(IngressOptions options) {
+  if (options.capacity == 0U) {
+    logs::log(ERR, "Ingress queue capacity must be at least 1\n");
+    return;
+  }
+
+  ingress_ = options;
+}
+
+void Service::impl::publishStatsSnapshot() {
+  json j = metrics_registry_.snapshot();
+
+  json senders = json::array();
+
+  for (auto const& s : senderStats()) {
+    char id[17];
+
+    std::snprintf(id, sizeof(id), "%016llx",
+                  static_cast<unsigned long long>(s.sender));
+    senders.push_back({
+        {"sender", id},
+        {"received", s.received},
+        {"lost", s.lost},
+        {"late", s.late},
+        {"last_seq", s.lastSeq},
+        {"oneway_ns",
+         {{"count", s.latencyNs.count},
+          {"min", s.latencyNs.min},
+          {"max", s.latencyNs.max},
+          {"p50", s.latencyNs.p50},
+          {"p99", s.latencyNs.p99}}},
+    });
+  }
+
+  j["senders"] = std::move(senders);
+  j["service"] = desc_.name;
+  j["timestamp_ns"] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::system_clock::now().time_since_epoch())
+                          .count();
+
+  std::string topic = std::string{g_statsTopic} + desc_.name;
+  std::string payload = j.dump();
+  std::lock_guard<std::mutex> lock{pub_mtx_};
+
+  if (engine_.publish_raw_bytes(
+          topic, {reinterpret_cast<std::uint8_t*>(payload.data()),
+                  payload.size()}) != 0) {
+    logs::log(ERR, "Failed to publish stats on [%s]\n", topic.c_str());
+  }
+}
+
 }  // namespace zmq
 
 }  // namespace fsatutils
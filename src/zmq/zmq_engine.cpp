@@ -1,6 +1,7 @@
 #include <zmq.h>
 
 #include <fsatutils/errors.hpp>
+#include <fsatutils/metrics/metrics.hpp>
 #include <fsatutils/zmq/zmq_engine.hpp>
 #include <fsatutils/zmq/zprotocol.hpp>
 
@@ -127,18 +128,28 @@ ZMQEngine::~ZMQEngine() {
 
 int ZMQEngine::publish_raw_bytes(std::string_view topic,
                                  std::span<uint8_t> data) const {
+  static auto& reg = metrics::Registry::global();
+  static auto& published = reg.counter("zmq.published");
+  static auto& bytes = reg.counter("zmq.published_bytes");
+  static auto& failures = reg.counter("zmq.publish_failures");
+
   if (zmq_send(pub_, topic.data(), topic.size(), ZMQ_SNDMORE) < 0) {
+    failures.add();
     logs::log(ERR, "Failed to send topic! ZMQ error [%s]\n",
               zmq_strerror(errno));
     return -1;
   }
 
   if (zmq_send(pub_, data.data(), data.size(), 0) < 0) {
+    failures.add();
     logs::log(ERR, "Failed to send data! ZMQ error [%s]\n",
               zmq_strerror(errno));
     return -1;
   }
 
+  published.add();
+  bytes.add(topic.size() + data.size());
+
   return 0;
 }
 
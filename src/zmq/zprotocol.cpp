@@ -0,0 +1,458 @@
+#include <fsatutils/log/log.hpp>
+#include <fsatutils/zmq/zprotocol.hpp>
+
+namespace fsatutils {
+
+namespace zmq {
+
+namespace {
+
+/* Nesting allowed inside values that are skipped */
+constexpr int MAX_DEPTH = 32;
+
+bool hex4(const char*& q, const char* end, std::uint32_t& cp) noexcept {
+  if (end - q < 4) return false;
+
+  cp = 0;
+
+  for (int i = 0; i < 4; i++, q++) {
+    char c = *q;
+
+    cp <<= 4U;
+
+    if (c >= '0' && c <= '9') {
+      cp |= static_cast<std::uint32_t>(c - '0');
+    } else if (c >= 'a' && c <= 'f') {
+      cp |= static_cast<std::uint32_t>(c - 'a' + 10);
+    } else if (c >= 'A' && c <= 'F') {
+      cp |= static_cast<std::uint32_t>(c - 'A' + 10);
+    } else {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+char* utf8(char* o, std::uint32_t cp) noexcept {
+  if (cp < 0x80U) {
+    *o++ = static_cast<char>(cp);
+  } else if (cp < 0x800U) {
+    *o++ = static_cast<char>(0xC0U | (cp >> 6U));
+    *o++ = static_cast<char>(0x80U | (cp & 0x3FU));
+  } else if (cp < 0x10000U) {
+    *o++ = static_cast<char>(0xE0U | (cp >> 12U));
+    *o++ = static_cast<char>(0x80U | ((cp >> 6U) & 0x3FU));
+    *o++ = static_cast<char>(0x80U | (cp & 0x3FU));
+  } else {
+    *o++ = static_cast<char>(0xF0U | (cp >> 18U));
+    *o++ = static_cast<char>(0x80U | ((cp >> 12U) & 0x3FU));
+    *o++ = static_cast<char>(0x80U | ((cp >> 6U) & 0x3FU));
+    *o++ = static_cast<char>(0x80U | (cp & 0x3FU));
+  }
+
+  return o;
+}
+
+/* Recursive descent over the payload, filling the Command as it goes */
+class CommandParser {
+ public:
+  CommandParser(std::span<const uint8_t> in, std::pmr::memory_resource* mr)
+      : begin_{reinterpret_cast<const char*>(in.data())},
+        p_{begin_},
+        end_{begin_ + in.size()},
+        mr_{mr} {}
+
+  bool parse(Command& cmd);
+
+  const char* error() const noexcept { return error_; }
+
+  std::size_t offset() const noexcept {
+    return static_cast<std::size_t>(p_ - begin_);
+  }
+
+ private:
+  bool fail(const char* why) noexcept {
+    error_ = why;
+    return false;
+  }
+
+  void ws() noexcept {
+    while (p_ < end_ &&
+           (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+      p_++;
+    }
+  }
+
+  bool peek(char c) noexcept {
+    ws();
+    return p_ < end_ && *p_ == c;
+  }
+
+  bool consume(char c) noexcept {
+    if (!peek(c)) return false;
+
+    p_++;
+
+    return true;
+  }
+
+  bool literal(std::string_view lit) noexcept {
+    if (static_cast<std::size_t>(end_ - p_) < lit.size() ||
+        std::string_view{p_, lit.size()} != lit) {
+      return fail("invalid literal");
+    }
+
+    p_ += lit.size();
+
+    return true;
+  }
+
+  bool scanString(const char*& start, const char*& end, bool& escaped);
+  bool string(std::string_view& out);
+  bool unescape(const char* q, const char* end, std::string_view& out);
+  bool skipValue(int depth);
+  bool args(Command& cmd);
+  bool arg(Command& cmd);
+
+  const char* begin_;
+  const char* p_;
+  const char* end_;
+  std::pmr::memory_resource* mr_;
+  const char* error_ = "unexpected end of input";
+};
+
+bool CommandParser::parse(Command& cmd) {
+  bool has_command = false;
+
+  if (!consume('{')) return fail("expected an object");
+
+  if (!consume('}')) {
+    do {
+      std::string_view key;
+
+      if (!string(key)) return false;
+      if (!consume(':')) return fail("expected ':'");
+
+      if (key == "command") {
+        if (!peek('"')) return fail("\"command\" must be a string");
+        if (!string(cmd.cmd)) return false;
+
+        has_command = true;
+      } else if (key == "args") {
+        if (!args(cmd)) return false;
+      } else if (!skipValue(0)) {
+        return false;
+      }
+    } while (consume(','));
+
+    if (!consume('}')) return fail("expected ',' or '}'");
+  }
+
+  ws();
+
+  if (p_ != end_) return fail("trailing characters");
+  if (!has_command) return fail("missing \"command\"");
+
+  return true;
+}
+
+bool CommandParser::args(Command& cmd) {
+  cmd.args.clear();
+
+  if (peek('n')) return literal("null");
+  if (!consume('[')) return fail("\"args\" must be an array");
+  if (consume(']')) return true;
+
+  /* Avoids most regrowth, which the arena cannot reclaim */
+  cmd.args.reserve(8U);
+
+  do {
+    if (!arg(cmd)) return false;
+  } while (consume(','));
+
+  return consume(']') || fail("expected ',' or ']'");
+}
+
+bool CommandParser::arg(Command& cmd) {
+  ArgView a;
+  bool has_name = false;
+  bool has_value = false;
+
+  if (!consume('{')) return fail("argument must be an object");
+
+  if (!consume('}')) {
+    do {
+      std::string_view key;
+
+      if (!string(key)) return false;
+      if (!consume(':')) return fail("expected ':'");
+
+      if (key == "name" || key == "value") {
+        bool is_name = key == "name";
+
+        if (!peek('"')) return fail("argument fields must be strings");
+        if (!string(is_name ? a.name : a.value)) return false;
+
+        (is_name ? has_name : has_value) = true;
+      } else if (!skipValue(1)) {
+        return false;
+      }
+    } while (consume(','));
+
+    if (!consume('}')) return fail("expected ',' or '}'");
+  }
+
+  if (!has_name || !has_value) {
+    return fail("argument needs \"name\" and \"value\"");
+  }
+
+  cmd.args.push_back(a);
+
+  return true;
+}
+
+bool CommandParser::scanString(const char*& start, const char*& end,
+                               bool& escaped) {
+  if (!consume('"')) return fail("expected a string");
+
+  start = p_;
+  escaped = false;
+
+  for (; p_ < end_ && *p_ != '"'; p_++) {
+    if (static_cast<unsigned char>(*p_) < 0x20U) {
+      return fail("control character in string");
+    }
+
+    if (*p_ == '\\') {
+      escaped = true;
+
+      if (++p_ == end_) break;
+    }
+  }
+
+  if (p_ >= end_) return fail("unterminated string");
+
+  end = p_++;
+
+  return true;
+}
+
+bool CommandParser::string(std::string_view& out) {
+  const char* start;
+  const char* end;
+  bool escaped;
+
+  if (!scanString(start, end, escaped)) return false;
+
+  if (!escaped) {
+    out = {start, static_cast<std::size_t>(end - start)};
+    return true;
+  }
+
+  return unescape(start, end, out);
+}
+
+/* Unescaping never grows a string, so the raw length bounds the output */
+bool CommandParser::unescape(const char* q, const char* end,
+                             std::string_view& out) {
+  auto* buf = static_cast<char*>(
+      mr_->allocate(static_cast<std::size_t>(end - q), 1U));
+  char* o = buf;
+
+  while (q < end) {
+    if (*q != '\\') {
+      *o++ = *q++;
+      continue;
+    }
+
+    q++;
+
+    switch (*q++) {
+      case '"':
+        *o++ = '"';
+        break;
+      case '\\':
+        *o++ = '\\';
+        break;
+      case '/':
+        *o++ = '/';
+        break;
+      case 'b':
+        *o++ = '\b';
+        break;
+      case 'f':
+        *o++ = '\f';
+        break;
+      case 'n':
+        *o++ = '\n';
+        break;
+      case 'r':
+        *o++ = '\r';
+        break;
+      case 't':
+        *o++ = '\t';
+        break;
+      case 'u': {
+        std::uint32_t cp;
+
+        if (!hex4(q, end, cp)) return fail("invalid \\u escape");
+
+        if (cp >= 0xDC00U && cp <= 0xDFFFU) {
+          return fail("unpaired surrogate");
+        }
+
+        if (cp >= 0xD800U && cp <= 0xDBFFU) {
+          std::uint32_t low;
+
+          if (end - q < 2 || q[0] != '\\' || q[1] != 'u') {
+            return fail("unpaired surrogate");
+          }
+
+          q += 2;
+
+          if (!hex4(q, end, low) || low < 0xDC00U || low > 0xDFFFU) {
+            return fail("unpaired surrogate");
+          }
+
+          cp = 0x10000U + ((cp - 0xD800U) << 10U) + (low - 0xDC00U);
+        }
+
+        o = utf8(o, cp);
+        break;
+      }
+      default:
+        return fail("invalid escape");
+    }
+  }
+
+  out = {buf, static_cast<std::size_t>(o - buf)};
+
+  return true;
+}
+
+bool CommandParser::skipValue(int depth) {
+  ws();
+
+  if (p_ >= end_) return fail("expected a value");
+
+  switch (*p_) {
+    case '"': {
+      const char* start;
+      const char* end;
+      bool escaped;
+
+      return scanString(start, end, escaped);
+    }
+    case '{': {
+      if (depth >= MAX_DEPTH) return fail("nesting too deep");
+
+      p_++;
+
+      if (consume('}')) return true;
+
+      do {
+        const char* start;
+        const char* end;
+        bool escaped;
+
+        if (!scanString(start, end, escaped)) return false;
+        if (!consume(':')) return fail("expected ':'");
+        if (!skipValue(depth + 1)) return false;
+      } while (consume(','));
+
+      return consume('}') || fail("expected ',' or '}'");
+    }
+    case '[': {
+      if (depth >= MAX_DEPTH) return fail("nesting too deep");
+
+      p_++;
+
+      if (consume(']')) return true;
+
+      do {
+        if (!skipValue(depth + 1)) return false;
+      } while (consume(','));
+
+      return consume(']') || fail("expected ',' or ']'");
+    }
+    case 't':
+      return literal("true");
+    case 'f':
+      return literal("false");
+    case 'n':
+      return literal("null");
+    default: {
+      const char* start = p_;
+
+      while (p_ < end_ && ((*p_ >= '0' && *p_ <= '9') || *p_ == '-' ||
+                           *p_ == '+' || *p_ == '.' || *p_ == 'e' ||
+                           *p_ == 'E')) {
+        p_++;
+      }
+
+      return p_ != start || fail("unexpected character");
+    }
+  }
+}
+
+}  // namespace
+
+std::optional<Command> parseJSON(std::span<const uint8_t> command,
+                                 std::pmr::memory_resource* mr) {
+  Command cmd{mr};
+  CommandParser parser{command, mr};
+
+  try {
+    if (!parser.parse(cmd)) {
+      logs::log(ERR, "Failed to parse JSON message: %s at byte %zu\n",
+                parser.error(), parser.offset());
+      return std::nullopt;
+    }
+  } catch (const std::exception& e) {
+    logs::log(ERR, "Exception raised in parsing JSON message: %s\n", e.what());
+    return std::nullopt;
+  }
+
+  return cmd;
+}
+
+void appendJSONString(std::string& out, std::string_view s) {
+  static constexpr char hex[] = "0123456789abcdef";
+
+  out += '"';
+
+  for (char c : s) {
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\r':
+        out += "\\r";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20U) {
+          out += "\\u00";
+          out += hex[static_cast<unsigned char>(c) >> 4U];
+          out += hex[static_cast<unsigned char>(c) & 0xFU];
+        } else {
+          out += c;
+        }
+    }
+  }
+
+  out += '"';
+}
+
+}  // namespace zmq
+
+}  // namespace fsatutils
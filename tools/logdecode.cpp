@@ -0,0 +1,78 @@
+#include <cstdio>
+#include <ctime>
+#include <exception>
+#include <fsatutils/log/binlog.hpp>
+#include <string_view>
+
+/* Turns binary logs written by logs::binlog back into text */
+
+namespace {
+
+std::string_view level_name(LogLevel level) {
+  switch (level) {
+    case LOG:
+      return "LOG";
+    case DEBUG:
+      return "DEBUG";
+    case INFO:
+      return "INFO";
+    case WARN:
+      return "WARN";
+    case ERR:
+      return "ERR";
+    default:
+      return "NONE";
+  }
+}
+
+void print(logs::binlog::Message const& msg, bool sources) {
+  std::time_t secs = static_cast<std::time_t>(msg.timestamp_ns / 1000000000U);
+  std::tm tm = {};
+  char when[32];
+
+  gmtime_r(&secs, &tm);
+  std::strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", &tm);
+
+  std::printf("%s.%09lluZ [%.*s] ", when,
+              static_cast<unsigned long long>(msg.timestamp_ns % 1000000000U),
+              static_cast<int>(level_name(msg.level).size()),
+              level_name(msg.level).data());
+
+  if (sources && !msg.file.empty()) {
+    std::printf("%.*s:%d: ", static_cast<int>(msg.file.size()),
+                msg.file.data(), msg.line);
+  }
+
+  std::printf("%s\n", msg.text.c_str());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bool sources = false;
+  int first = 1;
+
+  if (argc > 1 && std::string_view{argv[1]} == "-s") {
+    sources = true;
+    first = 2;
+  }
+
+  if (first >= argc) {
+    std::fprintf(stderr, "Usage: %s [-s] <binary log>...\n", argv[0]);
+    return 1;
+  }
+
+  try {
+    for (int i = first; i < argc; i++) {
+      logs::binlog::Decoder decoder{argv[i]};
+      logs::binlog::Message msg;
+
+      while (decoder.next(msg)) print(msg, sources);
+    }
+  } catch (std::exception const& e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+
+  return 0;
+}